@@ -2,6 +2,9 @@
 // Use of this source code is governed by an MIT-style
 // license that can be found in the LICENSE file.
 #include "board_manager.h"
+#include "hash.h"
+
+#include <stdio.h>
 
 extern lua_State* const main_lua_state;
 extern double current_timestamp;
@@ -311,9 +314,12 @@ static inline void push_piece_table(const struct zone* const zone)
 // Zone
 //TODO: somechecking that the widget being dropped/hovered is a zone/piece
 
+static struct widget_pool zone_pool;
+static struct widget_pool piece_pool;
+
 struct zone* zone_new(void* upcast, const struct zone_jump_table* const jump_table)
 {
-	struct zone* const zone = malloc(sizeof(struct zone));
+	struct zone* const zone = widget_pool_alloc(&zone_pool, sizeof(struct zone));
 
 	if (!zone)
 		return 0;
@@ -334,6 +340,11 @@ static void zone_gc(struct widget_interface* const widget)
 
 	if (zone->jump_table->gc)
 		zone->jump_table->gc(zone);
+
+	if (zone->jump_table->pool)
+		widget_pool_free(zone->jump_table->pool, zone->upcast);
+
+	free(zone->pieces);
 }
 
 static void zone_draw(const struct widget_interface* const widget)
@@ -348,6 +359,18 @@ static void zone_mask(const struct widget_interface* const widget)
 	zone->jump_table->mask(zone);
 }
 
+static size_t zone_batch_key(const struct widget_interface* const widget)
+{
+	const struct zone* const zone = (const struct zone*)widget->upcast;
+	return zone->jump_table->batch_key ? zone->jump_table->batch_key(zone) : 0;
+}
+
+static bool zone_instance(const struct widget_interface* const widget)
+{
+	const struct zone* const zone = (const struct zone*)widget->upcast;
+	return zone->jump_table->instance && zone->jump_table->instance(zone);
+}
+
 static void zone_drop_start(struct widget_interface* const zone_widget, struct widget_interface* const piece_widget)
 {
 	struct zone* const zone = zone_widget->upcast;
@@ -441,10 +464,13 @@ static int zone_index()
 static const struct widget_jump_table zone_to_widget_table =
 {
 	.uservalues = 1,
+	.pool = &zone_pool,
 
 	.gc = zone_gc,
 	.draw = zone_draw,
 	.mask = zone_mask,
+	.batch_key = zone_batch_key,
+	.instance = zone_instance,
 
 	.drop_start = zone_drop_start,
 	.drop_end = zone_drop_end,
@@ -458,7 +484,7 @@ static const struct widget_jump_table zone_to_widget_table =
 
 struct piece* piece_new(void* upcast, const struct piece_jump_table* const jump_table)
 {
-	struct piece* const piece = malloc(sizeof(struct piece));
+	struct piece* const piece = widget_pool_alloc(&piece_pool, sizeof(struct piece));
 
 	if (!piece)
 		return 0;
@@ -480,6 +506,9 @@ static void piece_gc(struct widget_interface* const widget)
 	struct piece* const piece = (struct piece*)widget->upcast;
 	if (piece->jump_table->gc)
 		piece->jump_table->gc(piece);
+
+	if (piece->jump_table->pool)
+		widget_pool_free(piece->jump_table->pool, piece->upcast);
 }
 
 static void piece_draw(const struct widget_interface* const widget)
@@ -592,6 +621,7 @@ static int piece_new_index()
 static const struct widget_jump_table piece_to_widget_table =
 {
 	.uservalues = 1,
+	.pool = &piece_pool,
 
 	.gc = piece_gc,
 	.draw = piece_draw,
@@ -667,6 +697,18 @@ static inline int board_manager_new_zone(lua_State* L)
 	return 1;
 }
 
+static bool zone_make(struct board_manager* const board_manager, const char* type)
+{
+	struct zone* const zone = zone_factory(type);
+
+	if (!zone)
+		return false;
+
+	zone->manager = board_manager;
+
+	return true;
+}
+
 static inline struct piece* piece_factory(const char* type)
 {
 	if (strcmp(type, "checker") == 0)
@@ -724,40 +766,183 @@ static inline int board_manager_new_piece(lua_State* L)
 	return 1;
 }
 
+static bool piece_make(struct board_manager* const board_manager, const char* type)
+{
+	struct piece* const piece = piece_factory(type);
+
+	if (!piece)
+		return false;
+
+	piece->manager = board_manager;
+
+	return true;
+}
+
+// Construct every zone or piece listed in one call, returning how many were made.
+//	Either manager:new_zones(type, ids, inits) with parallel arrays (inits is optional),
+//	or manager:new_zones(type, inits) where each init table has an id field.
+//	The engine pools are reserved once up front so the cost scales with the data, not the call count.
+static int board_manager_bulk_new(lua_State* L,
+	bool (*make)(struct board_manager* const, const char*),
+	int id_uvalue, int members_uvalue)
+{
+	struct board_manager* const board_manager = (struct board_manager*)luaL_checkudata(L, 1, "board_manager_mt");
+
+	if (!board_manager ||
+		lua_type(L, 2) != LUA_TSTRING ||
+		lua_type(L, 3) != LUA_TTABLE)
+	{
+		lua_settop(L, 0);
+
+		return 0;
+	}
+
+	const char* type = lua_tostring(L, 2);
+	const lua_Integer cnt = luaL_len(L, 3);
+
+	// A list of init tables carries its own ids, anything else in argument 3 is the ids
+	const bool parallel = lua_geti(L, 3, 1) != LUA_TTABLE;
+	const bool inits = lua_type(L, 4) == LUA_TTABLE;
+	lua_pop(L, 1);
+
+	lua_settop(L, 4);
+	lua_getiuservalue(L, 1, members_uvalue);
+
+	widget_engine_reserve((size_t)cnt);
+
+	lua_Integer made = 0;
+
+	for (lua_Integer i = 1; i <= cnt; i++)
+	{
+		// Push the id then the init table
+		if (parallel)
+		{
+			lua_geti(L, 3, i);
+
+			if (inits)
+				lua_geti(L, 4, i);
+			else
+				lua_pushnil(L);
+		}
+		else if (lua_geti(L, 3, i) == LUA_TTABLE)
+		{
+			lua_getfield(L, -1, "id");
+			lua_insert(L, -2);
+		}
+		else
+		{
+			lua_settop(L, 5);
+			continue;
+		}
+
+		if (lua_type(L, 6) == LUA_TNIL || lua_type(L, 6) == LUA_TTABLE)
+		{
+			lua_settop(L, 5);
+			continue;
+		}
+
+		if (lua_type(L, 7) != LUA_TTABLE)
+			lua_pop(L, 1);
+
+		// The factory consumes the init table and pushes the widget
+		if (!make(board_manager, type))
+		{
+			lua_settop(L, 5);
+			continue;
+		}
+
+		lua_pushvalue(L, 6);
+		lua_setiuservalue(L, -2, id_uvalue);
+
+		lua_settable(L, 5);
+		made++;
+	}
+
+	lua_settop(L, 0);
+	lua_pushinteger(L, made);
+
+	return 1;
+}
+
+static int board_manager_new_zones(lua_State* L)
+{
+	return board_manager_bulk_new(L, zone_make, ZONE_UVALUE_ID, MANAGER_UVALUE_ZONES);
+}
+
+static int board_manager_new_pieces(lua_State* L)
+{
+	return board_manager_bulk_new(L, piece_make, PIECE_UVALUE_ID, MANAGER_UVALUE_PIECES);
+}
+
+enum MANAGER_NEWINDEX_KEY
+{
+	MANAGER_NEWINDEX_VALID_MOVES,
+	MANAGER_NEWINDEX_MOVE,
+	MANAGER_NEWINDEX_NONVALID_MOVE,
+	MANAGER_NEWINDEX_AUTO_SNAP,
+	MANAGER_NEWINDEX_AUTO_HIGHLIGHT,
+};
+
+static const char* newindex_keys[] = {
+	"vaild_moves",
+	"move",
+	"nonvalid_move",
+	"auto_snap",
+	"auto_highlight",
+	NULL
+};
+
+enum MANAGER_INDEX_KEY
+{
+	MANAGER_INDEX_PIECES,
+	MANAGER_INDEX_ZONES,
+	MANAGER_INDEX_NEW_PIECE,
+	MANAGER_INDEX_NEW_ZONE,
+	MANAGER_INDEX_MOVE,
+	MANAGER_INDEX_NEW_PIECES,
+	MANAGER_INDEX_NEW_ZONES,
+};
+
+static const char* index_keys[] = {
+	"pieces",
+	"zones",
+	"new_piece",
+	"new_zone",
+	"move",
+	"new_pieces",
+	"new_zones",
+	NULL
+};
+
+// Built in board_manager_init
+static struct hash_table* newindex_table;
+static struct hash_table* index_table;
+
 static int board_manager_newindex(lua_State* L)
 {
 	struct board_manager* const board_manager = (struct board_manager*)luaL_checkudata(L, -3, "board_manager_mt");
 
 	if (lua_type(L, -2) == LUA_TSTRING)
 	{
-		const char* key = luaL_checkstring(L, -2);
-
-		if (strcmp(key, "vaild_moves") == 0)
+		switch (hash_table_get(newindex_table, luaL_checkstring(L, -2)))
 		{
+		case MANAGER_NEWINDEX_VALID_MOVES:
 			lua_setiuservalue(L, -3, MANAGER_UVALUE_VALID_MOVES);
 			return 1;
-		}
 
-		if (strcmp(key, "move") == 0)
-		{
+		case MANAGER_NEWINDEX_MOVE:
 			lua_setiuservalue(L, -3, MANAGER_UVALUE_MOVE);
 			return 1;
-		}
 
-		if (strcmp(key, "nonvalid_move") == 0)
-		{
+		case MANAGER_NEWINDEX_NONVALID_MOVE:
 			lua_setiuservalue(L, -3, MANAGER_UVALUE_NONVALID_MOVE);
 			return 1;
-		}
 
-		if (strcmp(key, "auto_snap") == 0)
-		{
+		case MANAGER_NEWINDEX_AUTO_SNAP:
 			board_manager->auto_snap = lua_toboolean(L, -1);
 			return 0;
-		}
 
-		if (strcmp(key, "auto_highlight") == 0)
-		{
+		case MANAGER_NEWINDEX_AUTO_HIGHLIGHT:
 			board_manager->auto_highlight = lua_toboolean(L, -1);
 			return 0;
 		}
@@ -772,36 +957,35 @@ static int board_manager_index(lua_State* L)
 
 	if (lua_type(L, -1) == LUA_TSTRING)
 	{
-		const char* key = luaL_checkstring(L, -1);
-
-		if (strcmp(key, "pieces") == 0)
+		switch (hash_table_get(index_table, luaL_checkstring(L, -1)))
 		{
+		case MANAGER_INDEX_PIECES:
 			lua_getiuservalue(L, -2, MANAGER_UVALUE_PIECES);
 			return 1;
-		}
 
-		if (strcmp(key, "zones") == 0)
-		{
+		case MANAGER_INDEX_ZONES:
 			lua_getiuservalue(L, -2, MANAGER_UVALUE_ZONES);
 			return 1;
-		}
 
-		if (strcmp(key, "new_piece") == 0)
-		{
+		case MANAGER_INDEX_NEW_PIECE:
 			lua_pushcfunction(L, board_manager_new_piece);
 			return 1;
-		}
-		
-		if (strcmp(key, "new_zone") == 0)
-		{
+
+		case MANAGER_INDEX_NEW_ZONE:
 			lua_pushcfunction(L, board_manager_new_zone);
 			return 1;
-		}
 
-		if (strcmp(key, "move") == 0)
-		{
+		case MANAGER_INDEX_MOVE:
 			lua_pushcfunction(L, manual_move);
 			return 1;
+
+		case MANAGER_INDEX_NEW_PIECES:
+			lua_pushcfunction(L, board_manager_new_pieces);
+			return 1;
+
+		case MANAGER_INDEX_NEW_ZONES:
+			lua_pushcfunction(L, board_manager_new_zones);
+			return 1;
 		}
 	}
 
@@ -867,6 +1051,16 @@ static int board_manager_new(lua_State* L)
 // ( Currently runs duing lua init, before allegro init.)
 void board_manager_init(lua_State* L)
 {
+	// Build the key dispatch hashes
+	newindex_table = hash_table_new(newindex_keys);
+	index_table = hash_table_new(index_keys);
+
+	if (!newindex_table || !index_table)
+	{
+		fprintf(stderr, "Failed to build board manager key hashes.\n");
+		return;
+	}
+
 	// global contructor
 	lua_pushcfunction(L, board_manager_new);
 	lua_setglobal(L, "board_manager_new");
@@ -70,10 +70,14 @@ struct board_manager
 
 struct zone_jump_table
 {
+	struct widget_pool* pool; // If set the upcast is recycled into it after gc
+
 	void (*gc)(struct zone* const);
 	void (*draw)(const struct zone* const);
 	void (*mask)(const struct zone* const);
 	void (*update)(struct zone* const);
+	size_t (*batch_key)(const struct zone* const); // See widget_jump_table
+	bool (*instance)(const struct zone* const); // See widget_jump_table
 
 	void (*highligh_start)(struct zone* const);
 	void (*highligh_end)(struct zone* const);
@@ -87,6 +91,8 @@ struct zone_jump_table
 
 struct piece_jump_table
 {
+	struct widget_pool* pool; // If set the upcast is recycled into it after gc
+
 	void (*gc)(struct piece* const);
 	void (*draw)(const struct piece* const);
 	void (*mask)(const struct piece* const);
@@ -52,6 +52,7 @@ WG_DECL(hover_start)
 	WG_CAST
 
 	button->color = primary_pallet.highlight;
+	widget_interface_invalidate(widget_interface);
 }
 
 WG_DECL(hover_end)
@@ -59,10 +60,14 @@ WG_DECL(hover_end)
 	WG_CAST
 
 	button->color = primary_pallet.main;
+	widget_interface_invalidate(widget_interface);
 }
 
 WG_JMP_TBL
 {
+	.pool = WG_POOL,
+	.cache_draw = true,
+
 	.draw = draw,
 
 	// TODO: Investigate why seting mask to draw causes such a strange error. 
@@ -16,6 +16,17 @@ void camera_global_predraw()
 		camera_tweener->current[3],
 		camera_tweener->current[4]
 	);
+
+	// For render_interfaces with GPU evaluated keyframes
+	const float camera_keyframe[5] = {
+		camera_tweener->current[0],
+		camera_tweener->current[1],
+		camera_tweener->current[2],
+		camera_tweener->current[3],
+		camera_tweener->current[4]
+	};
+
+	al_set_shader_float_vector("camera_keyframe", 1, camera_keyframe, 5);
 }
 
 void camera_push_keyframe(const struct keyframe* const frame)
@@ -58,6 +69,15 @@ void camera_compose_transform(ALLEGRO_TRANSFORM* const trans, const double blend
 	al_compose_transform(trans, &buffer);
 }
 
+void camera_copy_current(struct keyframe* const keyframe)
+{
+	keyframe->x = camera_tweener->current[0];
+	keyframe->y = camera_tweener->current[1];
+	keyframe->sx = camera_tweener->current[2];
+	keyframe->sy = camera_tweener->current[3];
+	keyframe->theta = camera_tweener->current[4];
+}
+
 void camera_copy_destination(struct keyframe* const keyframe)
 {
 	double* coords =  tweener_destination(camera_tweener);
@@ -15,4 +15,5 @@ void camera_compose_transform(ALLEGRO_TRANSFORM* const, const double);
 void camera_set_keyframe(const struct keyframe* const);
 void camera_push_keyframe(const struct keyframe* const);
 void camera_copy_destination(struct keyframe* const);
+void camera_copy_current(struct keyframe* const);
 void camera_interupt();
\ No newline at end of file
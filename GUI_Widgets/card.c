@@ -6,6 +6,7 @@
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_font.h>
 #include <allegro5/allegro_opengl.h>
+#include "render_state.h"
 
 extern ALLEGRO_FONT* debug_font;
 extern double mouse_x, mouse_y;
@@ -23,7 +24,7 @@ static void draw(const struct widget_interface* const widget_interface)
 {
 	const struct card* const card = (const struct card*)widget_interface->upcast;
 
-	glEnable(GL_STENCIL_TEST);	
+	render_state_stencil_test(true);
 
 	// Draw card background
 	glStencilFunc(GL_ALWAYS, 1, 0x07);
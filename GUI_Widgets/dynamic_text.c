@@ -3,6 +3,7 @@
 // license that can be found in the LICENSE file.
 
 #include "dynamic_text.h"
+#include "render_state.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -51,12 +52,13 @@ static void dynamic_text_animation_still(const struct dynamic_text* const dynami
 
 static void dynamic_text_animation_worm_(const struct dynamic_text* const dynamic_text, double timestamp)
 {
-	const ALLEGRO_TRANSFORM* const buffer = al_get_current_transform();
+	// A copy since the current transform is overwritten in place
+	const ALLEGRO_TRANSFORM buffer = *al_get_current_transform();
 	ALLEGRO_TRANSFORM tmp;
 
 	dynamic_text_build_transform(dynamic_text, &tmp);
-	al_compose_transform(&tmp, buffer);
-	al_use_transform(&tmp);
+	al_compose_transform(&tmp, &buffer);
+	render_state_transform(&tmp);
 
 	al_draw_text(dynamic_text->font,
 		al_map_rgb(255, 255, 255),
@@ -64,7 +66,7 @@ static void dynamic_text_animation_worm_(const struct dynamic_text* const dynami
 		ALLEGRO_ALIGN_CENTRE,
 		dynamic_text->text);
 
-	al_use_transform(buffer);
+	render_state_transform(&buffer);
 }
 
 static void dynamic_text_animation_worm(const struct dynamic_text* const dynamic_text, double timestamp)
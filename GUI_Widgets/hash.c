@@ -5,6 +5,7 @@
 #include "hash.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 
 #ifdef HASH_DEBUG
 #include <stdio.h>
@@ -77,26 +78,43 @@ static const uint8_t index[] = {
 	0x67, 0x4A, 0xED, 0xDE, 0xC5, 0x31, 0xFE, 0x18, 0x0D, 0x63, 0x8C, 0x80, 0xC0, 0xF7, 0x70, 0x07
 };
 
-static uint8_t inline encode_character(char c)
+// Encoding, following the note at the top.
+// The key is fingerprinted with the salt (FNV-1a) so every byte of the block depends on every character,
+// then the fingerprint is stretched into the block with a counter based mix (murmur3's finalizer).
+
+static uint32_t inline encode_fingerprint(const char* src, uint32_t salt)
 {
-	return (uint8_t)c;
+	uint32_t fingerprint = 2166136261u ^ salt;
+
+	for (; *src; src++)
+		fingerprint = (fingerprint ^ (uint8_t)*src) * 16777619u;
+
+	return fingerprint;
+}
+
+// The stretch must not be linear over GF(2) (like xorshift) or the rows share a 32 dimensional subspace and go singular.
+static uint8_t inline encode_next(uint32_t* state)
+{
+	uint32_t x = (*state += 0x9E3779B9u);
+
+	x ^= x >> 16;
+	x *= 0x85EBCA6Bu;
+	x ^= x >> 13;
+	x *= 0xC2B2AE35u;
+	x ^= x >> 16;
+
+	return (uint8_t)(x >> 24);
 }
 
-static void inline encode_block(const char* src, uint8_t* dest, size_t length)
+static void inline encode_block(const char* src, uint32_t salt, uint8_t* dest, size_t length)
 {
 	if (!src || !dest)
 		return;
 
-	size_t idx = 0;
-
-	for (; idx < length; idx++)
-		if (src[idx] != '\0')
-			dest[idx] = encode_character(src[idx]);
-		else
-			break;
+	uint32_t state = encode_fingerprint(src, salt);
 
-	for (; idx < length; idx++)
-		dest[idx] = 0;
+	for (size_t idx = 0; idx < length; idx++)
+		dest[idx] = encode_next(&state);
 }
 
 static uint8_t inline gadd(uint8_t a, uint8_t b)
@@ -202,7 +220,8 @@ static void inline augmented_matrix_scale_and_add_row(struct augmented_matrix* m
 	matrix->constants[i] = gadd(matrix->constants[i], buffer);
 }
 
-static void inline augmented_matrix_gaussian_elimination(struct augmented_matrix* matrix)
+// Solve the system in place, false if the matrix is singular
+static bool inline augmented_matrix_gaussian_elimination(struct augmented_matrix* matrix)
 {
 	// Make the matrix an upper triangluar with leading zeros
 	for (size_t i = 0; i < matrix->size; i++)
@@ -218,7 +237,7 @@ static void inline augmented_matrix_gaussian_elimination(struct augmented_matrix
 #ifdef HASH_DEBUG
 			printf("CRITICAL ERROR: matrix is singular\n"); 
 #endif
-			return;	
+			return false;
 		}
 
 		augmented_matrix_scale_row(matrix, i, ginv(leading_val));
@@ -237,13 +256,20 @@ static void inline augmented_matrix_gaussian_elimination(struct augmented_matrix
 		for (size_t j = 0; j < i; j++)
 			if (matrix->matrix[matrix->size * j + i])
 				augmented_matrix_scale_and_add_row(matrix, j, i, matrix->matrix[matrix->size * j + i]);
+
+	return true;
 }
 
 // Actual Hashing
 
+// Salts to try before giving up, a random matrix over GF(2^8) is singular well under 1% of the time.
+// (Duplicate keys are always singular.)
+#define HASH_MAX_SALTS 64
+
 struct hash_data
 {
 	size_t n;
+	uint32_t salt;
 	uint8_t* coefficients;
 };
 
@@ -256,81 +282,156 @@ static size_t get_key_cnt(const char* keys[])
 	return --cnt;
 }
 
+// Find coefficients such that hash(keys[i]) = values[i] (or i if values is NULL), NULL on failure.
 struct hash_data* calc_hash_data(const char* keys[], uint8_t* values)
 {
 	const size_t n = get_key_cnt(keys);
 
-	struct augmented_matrix handle = (struct augmented_matrix)
-	{
-		.size = n,
-		.matrix = malloc(n * n * sizeof(uint8_t)),
-		.constants = values,
-	};
+	struct hash_data* output = malloc(sizeof(struct hash_data));
+	uint8_t* matrix = malloc(n * n * sizeof(uint8_t) + 1);
+	uint8_t* constants = malloc(n * sizeof(uint8_t) + 1);
 
-	if (!values)
+	if (!output || !matrix || !constants)
+		goto fail;
+
+	output->n = n;
+	output->coefficients = malloc(n * sizeof(uint8_t) + 1);
+
+	if (!output->coefficients)
+		goto fail;
+
+	for (uint32_t salt = 0; salt < HASH_MAX_SALTS; salt++)
 	{
-		handle.constants = malloc(n * sizeof(uint8_t));
+		struct augmented_matrix handle = (struct augmented_matrix)
+		{
+			.size = n,
+			.matrix = matrix,
+			.constants = constants,
+		};
 
 		for (size_t i = 0; i < n; i++)
-			handle.constants[i] = (uint8_t)i;
-	}
+		{
+			encode_block(keys[i], salt, handle.matrix + i * n, n);
+			handle.constants[i] = values ? values[i] : (uint8_t)i;
+		}
 
-	for (size_t i = 0; i < n; i++)
-		encode_block(keys[i], handle.matrix + i * n, n);
+		if (!augmented_matrix_gaussian_elimination(&handle))
+			continue;
 
-	augmented_matrix_gaussian_elimination(&handle);
+		memcpy(output->coefficients, handle.constants, n * sizeof(uint8_t));
+		output->salt = salt;
 
-	struct hash_data* output = malloc(sizeof(struct hash_data));
-	output->coefficients = malloc(n * sizeof(struct hash_data));
+		free(matrix);
+		free(constants);
 
-	memcpy(output->coefficients, handle.constants, n * sizeof(uint8_t));
-	output->n = n;
+		return output;
+	}
 
-	if (!values)
-		free(handle.constants);
+fail:
+	if (output)
+		free(output->coefficients);
 
-	free(handle.matrix);
+	free(output);
+	free(matrix);
+	free(constants);
 
-	return output;
+	return NULL;
 }
 
-uint8_t hash(struct hash_data* hash_data, const char* key)
+uint8_t hash(const struct hash_data* hash_data, const char* key)
 {
 	uint8_t output = 0;
+	uint32_t state = encode_fingerprint(key, hash_data->salt);
 
 	for (size_t i = 0; i < hash_data->n; i++)
-		if (key[i] != '\0')
-			output ^= gmul(encode_character(key[i]), hash_data->coefficients[i]);
-		else
-			break;
+		output ^= gmul(encode_next(&state), hash_data->coefficients[i]);
 
 	return output;
 }
 
 // Hash table
+// A perfect hash from the keys to their index, any other string hashes to some index so the key is compared once.
 
 struct hash_table
 {
 	struct hash_data;
-	const char*** keys;
+	const char** keys;
 };
 
-struct hash_table* hash_table_new(const char*** keys)
+struct hash_table* hash_table_new(const char* keys[])
+{
+	return hash_table_new_strided(keys, sizeof(const char*));
+}
+
+// Build from an array of structs whose first member is the key, ended by a NULL key.
+struct hash_table* hash_table_new_strided(const void* entries, size_t stride)
 {
+	size_t n = 0;
+
+	while (*(const char* const*)((const char*)entries + n * stride))
+		n++;
+
+	if (n >= HASH_TABLE_MISS)
+		return NULL;
+
+	const char** keys = malloc((n + 1) * sizeof(const char*));
+
+	if (!keys)
+		return NULL;
+
+	for (size_t i = 0; i < n; i++)
+		keys[i] = *(const char* const*)((const char*)entries + i * stride);
+
+	keys[n] = NULL;
+
+	struct hash_data* data = calc_hash_data(keys, NULL);
 	struct hash_table* output = malloc(sizeof(struct hash_table));
 
-	struct hash_data* temp = calc_hash_data(keys, NULL);
+	if (!data || !output)
+	{
+		if (data)
+			free(data->coefficients);
+
+		free(data);
+		free(output);
+		free(keys);
+
+		return NULL;
+	}
 
 	*output = (struct hash_table)
 	{
-		.n = temp->n,
-		.coefficients = malloc(sizeof(uint8_t) * temp->n),
+		.n = data->n,
+		.salt = data->salt,
+		.coefficients = data->coefficients,
+		.keys = keys,
 	};
 
-	return NULL;
+	free(data);
+
+	return output;
 }
 
-uint8_t hash_table_get(struct hash_table* table, const char* key)
+void hash_table_free(struct hash_table* table)
 {
-	return 0;
+	if (!table)
+		return;
+
+	free(table->coefficients);
+	free(table->keys);
+	free(table);
+}
+
+// The index of the key, or HASH_TABLE_MISS if it isn't in the table.
+uint8_t hash_table_get(const struct hash_table* table, const char* key)
+{
+	if (!table || table->n == 0)
+		return HASH_TABLE_MISS;
+
+	const uint8_t idx = hash((const struct hash_data*)table, key);
+
+	if (idx < table->n && strcmp(table->keys[idx], key) == 0)
+		return idx;
+
+	return HASH_TABLE_MISS;
 }
@@ -2,12 +2,13 @@
 // Use of this source code is governed by an MIT-style
 // license that can be found in the LICENSE file.
 
-// This really isn't necessary at this time.
-// String hashing is only used in scripting and this implementation isn't that robust.
+// Perfect hashing of small fixed key sets over GF(2^8), used to dispatch lua keys in __index and __newindex.
+// Built once at init, a lookup is one hash and one string compare.
 
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 struct hash_data;
 
@@ -19,7 +20,11 @@ uint8_t hash(const struct hash_data*, const char*);
 
 struct hash_table;
 
+#define HASH_TABLE_MISS UINT8_MAX
+
 struct hash_table* hash_table_new(const char* []);
-uint8_t hash_table_get(struct hash_table*, const char*);
+struct hash_table* hash_table_new_strided(const void*, size_t);
+void hash_table_free(struct hash_table*);
+uint8_t hash_table_get(const struct hash_table*, const char*);
 
 
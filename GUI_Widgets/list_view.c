@@ -0,0 +1,427 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+#include "widget_interface.h"
+#include "widget_style_sheet.h"
+#include "hash.h"
+
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_font.h>
+#include "allegro5/allegro_primitives.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIDGET_TYPE list_view
+
+/* A scrolling list, or grid with more than one column, that only materializes the cells on screen.
+ *
+ * The cell text comes from the lua function list.row_data(index), only called when a cell is bound to a new index.
+ * Data is laid out left to right then top to bottom, and scrolling moves a whole row of columns at a time.
+ * There are only ever enough cells to fill the widget, the cell for data index i is cells[i % cell_cnt],
+ * so scrolling rebinds just the cells that came into view. Memory and draw cost don't depend on the list length.
+ */
+
+#define LIST_VIEW_TEXT_MAX 64
+#define LIST_VIEW_UNBOUND SIZE_MAX
+#define LIST_VIEW_SCROLL_ROWS 3
+
+extern double mouse_x, mouse_y;
+extern ALLEGRO_EVENT current_event;
+extern lua_State* main_lua_state;
+
+enum LIST_VIEW_UVALUE
+{
+	LIST_VIEW_UVALUE_ROW_DATA = 1,
+};
+
+struct list_cell
+{
+	size_t index;
+	char text[LIST_VIEW_TEXT_MAX];
+};
+
+struct list_view
+{
+	struct widget_interface* widget_interface;
+
+	size_t length;
+	size_t first;		// The data index of the top left cell, always the start of a row
+	size_t selected;	// LIST_VIEW_UNBOUND if nothing is selected
+	size_t columns;
+	double row_height;
+	bool hovered;
+
+	struct list_cell* cells;
+	size_t cell_cnt;
+};
+
+static size_t visible_rows(const struct list_view* const list_view)
+{
+	const size_t cnt = (size_t)(2 * list_view->widget_interface->render_interface->half_height / list_view->row_height);
+
+	return cnt ? cnt : 1;
+}
+
+// Keep the first row in range and at the start of a row
+static void clamp_first(struct list_view* const list_view)
+{
+	const size_t visible = visible_rows(list_view);
+	const size_t rows = (list_view->length + list_view->columns - 1) / list_view->columns;
+	const size_t max_first = (rows > visible ? rows - visible : 0) * list_view->columns;
+
+	list_view->first -= list_view->first % list_view->columns;
+
+	if (list_view->first > max_first)
+		list_view->first = max_first;
+}
+
+static void unbind_cells(struct list_view* const list_view)
+{
+	for (size_t i = 0; i < list_view->cell_cnt; i++)
+		list_view->cells[i].index = LIST_VIEW_UNBOUND;
+}
+
+// Keep just enough cells to fill the widget, only changes when the widget is resized or the columns change
+static bool fit_cells(struct list_view* const list_view)
+{
+	const size_t cnt = visible_rows(list_view) * list_view->columns;
+
+	if (list_view->cell_cnt == cnt)
+		return true;
+
+	struct list_cell* memsafe_hande = realloc(list_view->cells, cnt * sizeof(struct list_cell));
+
+	if (!memsafe_hande)
+		return false;
+
+	list_view->cells = memsafe_hande;
+	list_view->cell_cnt = cnt;
+
+	// More visible rows can leave first past the end
+	clamp_first(list_view);
+	unbind_cells(list_view);
+
+	return true;
+}
+
+// Pull the cell's text for the data index from lua
+static void bind_cell(const struct list_view* const list_view, struct list_cell* const cell, size_t index)
+{
+	cell->index = index;
+	cell->text[0] = '\0';
+
+	lua_getglobal(main_lua_state, "widgets");
+	lua_rawgetp(main_lua_state, -1, list_view->widget_interface);
+
+	if (LUA_TFUNCTION == lua_getiuservalue(main_lua_state, -1, LIST_VIEW_UVALUE_ROW_DATA))
+	{
+		lua_pushinteger(main_lua_state, (lua_Integer)index + 1);
+
+		if (LUA_OK == lua_pcall(main_lua_state, 1, 1, 0) && lua_isstring(main_lua_state, -1))
+			snprintf(cell->text, LIST_VIEW_TEXT_MAX, "%s", lua_tostring(main_lua_state, -1));
+	}
+
+	lua_pop(main_lua_state, 3);
+}
+
+// Cells are bound while drawing, the only per frame pass on the main thread where lua can be called.
+WG_DECL_DRAW
+{
+	WG_CAST
+	WG_DIMENSIONS
+
+	al_draw_filled_rounded_rectangle(-half_width, -half_height, half_width, half_height,
+		primary_pallet.edge_radius, primary_pallet.edge_radius,
+		primary_pallet.main);
+
+	if (fit_cells(list_view))
+	{
+		const double text_offset = 0.5 * (list_view->row_height - al_get_font_line_height(primary_font));
+		const double cell_width = 2 * half_width / list_view->columns;
+
+		for (size_t i = 0; i < list_view->cell_cnt && list_view->first + i < list_view->length; i++)
+		{
+			const size_t index = list_view->first + i;
+			struct list_cell* const cell = list_view->cells + index % list_view->cell_cnt;
+
+			if (cell->index != index)
+				bind_cell(list_view, cell, index);
+
+			const double left = -half_width + (i % list_view->columns) * cell_width;
+			const double top = -half_height + (i / list_view->columns) * list_view->row_height;
+
+			if (index == list_view->selected)
+				al_draw_filled_rectangle(left, top, left + cell_width, top + list_view->row_height,
+					primary_pallet.highlight);
+
+			al_draw_text(primary_font, primary_pallet.activated,
+				left + primary_pallet.edge_radius, top + text_offset,
+				ALLEGRO_ALIGN_LEFT, cell->text);
+		}
+	}
+
+	al_draw_rounded_rectangle(-half_width, -half_height, half_width, half_height,
+		primary_pallet.edge_radius, primary_pallet.edge_radius,
+		primary_pallet.edge, primary_pallet.edge_width);
+}
+
+WG_DECL_MASK
+{
+	WG_CAST_DRAW
+
+	al_draw_filled_rounded_rectangle(-half_width, -half_height, half_width, half_height,
+		primary_pallet.edge_radius, primary_pallet.edge_radius,
+		al_map_rgb(255, 255, 255));
+}
+
+WG_DECL(gc)
+{
+	WG_CAST
+
+	free(list_view->cells);
+	list_view->cells = NULL;
+	list_view->cell_cnt = 0;
+}
+
+// Scroll with the mouse wheel while hovered
+WG_DECL(event_handler)
+{
+	WG_CAST
+
+	if (!list_view->hovered || current_event.mouse.dz == 0)
+		return;
+
+	const long long step = -(long long)current_event.mouse.dz * LIST_VIEW_SCROLL_ROWS * (long long)list_view->columns;
+
+	list_view->first = step < 0 && (size_t)-step > list_view->first ? 0 : list_view->first + step;
+	clamp_first(list_view);
+	widget_interface_invalidate(widget_interface);
+}
+
+WG_DECL(left_click)
+{
+	WG_CAST
+	WG_DIMENSIONS
+
+	double x = mouse_x;
+	double y = mouse_y;
+	widget_screen_to_local(widget_interface, &x, &y);
+
+	if (y < -half_height || x < -half_width)
+		return;
+
+	const size_t column = (size_t)((x + half_width) * list_view->columns / (2 * half_width));
+
+	if (column >= list_view->columns)
+		return;
+
+	// The strip under the last whole row isn't drawn
+	const size_t row = (size_t)((y + half_height) / list_view->row_height);
+
+	if (row >= visible_rows(list_view))
+		return;
+
+	const size_t index = list_view->first + row * list_view->columns + column;
+
+	if (index < list_view->length)
+		list_view->selected = index;
+
+	widget_interface_invalidate(widget_interface);
+}
+
+WG_DECL(hover_start)
+{
+	WG_CAST
+	list_view->hovered = true;
+}
+
+WG_DECL(hover_end)
+{
+	WG_CAST
+	list_view->hovered = false;
+}
+
+enum LIST_VIEW_KEY
+{
+	LIST_VIEW_KEY_LENGTH,
+	LIST_VIEW_KEY_FIRST,
+	LIST_VIEW_KEY_COLUMNS,
+	LIST_VIEW_KEY_SELECTED,
+	LIST_VIEW_KEY_ROW_DATA,
+};
+
+static const char* keys[] = {
+	"length",
+	"first",
+	"columns",
+	"selected",
+	"row_data",
+	NULL
+};
+
+// The key dispatch hash, built on first use
+static uint8_t list_view_key(lua_State* L, int idx)
+{
+	static struct hash_table* key_table = NULL;
+
+	if (!key_table && !(key_table = hash_table_new(keys)))
+		luaL_error(L, "Failed to build the list view key hash.");
+
+	if (lua_type(L, idx) != LUA_TSTRING)
+		return HASH_TABLE_MISS;
+
+	return hash_table_get(key_table, lua_tostring(L, idx));
+}
+
+// Indices are 1 based on the lua side
+static int index()
+{
+	struct widget_interface* const widget_interface = (struct widget_interface*)luaL_checkudata(main_lua_state, -2, "widget_mt");
+	const struct list_view* const list_view = (const struct list_view*)widget_interface->upcast;
+
+	switch (list_view_key(main_lua_state, -1))
+	{
+	case LIST_VIEW_KEY_LENGTH:
+		lua_pushinteger(main_lua_state, (lua_Integer)list_view->length);
+		return 1;
+
+	case LIST_VIEW_KEY_FIRST:
+		lua_pushinteger(main_lua_state, (lua_Integer)list_view->first + 1);
+		return 1;
+
+	case LIST_VIEW_KEY_COLUMNS:
+		lua_pushinteger(main_lua_state, (lua_Integer)list_view->columns);
+		return 1;
+
+	case LIST_VIEW_KEY_SELECTED:
+		if (list_view->selected == LIST_VIEW_UNBOUND)
+			lua_pushnil(main_lua_state);
+		else
+			lua_pushinteger(main_lua_state, (lua_Integer)list_view->selected + 1);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static int newindex()
+{
+	struct widget_interface* const widget_interface = (struct widget_interface*)luaL_checkudata(main_lua_state, -3, "widget_mt");
+	struct list_view* const list_view = (struct list_view*)widget_interface->upcast;
+
+	switch (list_view_key(main_lua_state, -2))
+	{
+	// Changing the data rebinds every cell
+	case LIST_VIEW_KEY_ROW_DATA:
+		lua_setiuservalue(main_lua_state, -3, LIST_VIEW_UVALUE_ROW_DATA);
+		unbind_cells(list_view);
+		break;
+
+	case LIST_VIEW_KEY_LENGTH:
+	{
+		const lua_Integer length = luaL_checkinteger(main_lua_state, -1);
+
+		list_view->length = length > 0 ? (size_t)length : 0;
+
+		if (list_view->selected != LIST_VIEW_UNBOUND && list_view->selected >= list_view->length)
+			list_view->selected = LIST_VIEW_UNBOUND;
+
+		clamp_first(list_view);
+		unbind_cells(list_view);
+		break;
+	}
+
+	case LIST_VIEW_KEY_FIRST:
+	{
+		const lua_Integer first = luaL_checkinteger(main_lua_state, -1);
+
+		list_view->first = first > 1 ? (size_t)first - 1 : 0;
+		clamp_first(list_view);
+		break;
+	}
+
+	// The cells are refit on the next draw
+	case LIST_VIEW_KEY_COLUMNS:
+	{
+		const lua_Integer columns = luaL_checkinteger(main_lua_state, -1);
+
+		list_view->columns = columns > 1 ? (size_t)columns : 1;
+		clamp_first(list_view);
+		break;
+	}
+
+	default:
+		return 0;
+	}
+
+	widget_interface_invalidate(widget_interface);
+
+	return 0;
+}
+
+WG_JMP_TBL
+{
+	.pool = WG_POOL,
+	.uservalues = 1,
+	.cache_draw = true,
+	.event_mask = WIDGET_EVENT_MASK(MOUSE_AXES),
+
+	.gc = gc,
+	.draw = draw,
+	.mask = mask,
+	.event_handler = event_handler,
+
+	.left_click = left_click,
+	.hover_start = hover_start,
+	.hover_end = hover_end,
+
+	.index = index,
+	.newindex = newindex,
+};
+
+WG_DECL_NEW
+{
+	lua_Integer length = 0;
+	lua_Integer columns = 1;
+	double row_height = 0;
+
+	if (lua_istable(L, -1))
+	{
+		lua_getfield(L, -1, "length");
+
+		if (lua_isinteger(L, -1))
+			length = lua_tointeger(L, -1);
+
+		lua_getfield(L, -2, "row_height");
+
+		if (lua_isnumber(L, -1))
+			row_height = lua_tonumber(L, -1);
+
+		lua_getfield(L, -3, "columns");
+
+		if (lua_isinteger(L, -1))
+			columns = lua_tointeger(L, -1);
+
+		lua_pop(L, 3);
+	}
+
+	WG_NEW
+	{
+		WG_NEW_HEADER,
+		.length = length > 0 ? (size_t)length : 0,
+		.first = 0,
+		.selected = LIST_VIEW_UNBOUND,
+		.columns = columns > 1 ? (size_t)columns : 1,
+		.row_height = row_height > 0 ? row_height : 1.5 * al_get_font_line_height(primary_font),
+		.hovered = false,
+		.cells = NULL,
+		.cell_cnt = 0,
+	};
+
+	WIDGET_MIN_DIMENSIONS(150, 200)
+
+	return 1;
+}
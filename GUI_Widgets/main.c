@@ -30,6 +30,7 @@ void thread_pool_init(size_t);
 void thread_pool_destroy();
 
 // Renderer includes
+#include "render_state.h"
 struct work_queue* render_interface_update();
 void render_interface_init();
 void render_interface_global_predraw();
@@ -76,6 +77,7 @@ const double easy_background_speed = 0;
 // A simple FPS Monitor
 #ifdef EASY_FPS
 static double last_render_timestamp;
+static struct render_state_counters last_render_state;
 #endif
 
 // These varitables are keep seperate from their normal use so they don't change during processing  
@@ -295,6 +297,26 @@ static inline void process_event()
     widget_engine_event_handler();
 }
 
+// Merge the run of mouse motion events at the head of the queue into current_event.
+// The deltas are summed and the position is the latest, current_event must already be dropped from the queue.
+static inline void coalesce_mouse_axes()
+{
+    ALLEGRO_EVENT next;
+
+    while (al_peek_next_event(main_event_queue, &next)
+        && next.type == ALLEGRO_EVENT_MOUSE_AXES
+        && next.any.timestamp <= future_timestamp)
+    {
+        next.mouse.dx += current_event.mouse.dx;
+        next.mouse.dy += current_event.mouse.dy;
+        next.mouse.dz += current_event.mouse.dz;
+        next.mouse.dw += current_event.mouse.dw;
+
+        current_event = next;
+        al_drop_next_event(main_event_queue);
+    }
+}
+
 // On an update and also draw, depending on flag
 static inline void update_and_draw(const bool do_draw)
 {
@@ -304,12 +326,12 @@ static inline void update_and_draw(const bool do_draw)
     // future_timestamp and current_time_stamp must be accurate upon calling this function.
     delta_timestamp = future_timestamp - current_timestamp;
 
-    // Update tweeners
+    // Update free tweeners (like the camera's)
     struct work_queue* queue = tweener_update();
     thread_pool_concatenate(queue);
 
     // Update render_interfaces
-    // (Currently only copies changes from keyframe tweeners across.)
+    // (Blends the moving keyframe tweeners directly into the current keyframes.)
     queue = render_interface_update();
     thread_pool_concatenate(queue);
 
@@ -339,18 +361,19 @@ static inline void update_and_draw(const bool do_draw)
 
     // Process predraw then wait
     al_set_target_bitmap(al_get_backbuffer(display));
-    al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+    render_state_invalidate();
+    render_state_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
     al_set_render_state(ALLEGRO_ALPHA_TEST, 1);
 
     glStencilMask(0xFF);
     glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_STENCIL_TEST);
+    render_state_stencil_test(true);
     al_reset_clipping_rectangle();
 
     render_interface_global_predraw();
  
 #ifdef EASY_BACKGROUND
-    al_use_transform(&identity_transform);
+    render_state_transform(&identity_transform);
     material_apply( NULL);
     const double easy_background_offset = -fmod(easy_background_speed * current_timestamp, 100);
     al_draw_bitmap(easy_background, easy_background_offset, easy_background_offset, 0);
@@ -362,10 +385,16 @@ static inline void update_and_draw(const bool do_draw)
     widget_engine_draw();
 
 #ifdef EASY_FPS
-    al_use_transform(&identity_transform);
+    render_state_transform(&identity_transform);
     material_apply(NULL);
     al_draw_textf(debug_font, al_map_rgb_f(0, 1, 0), 0, 0, 0, "FPS:%lf  Timestamp:%lf",1.0/(current_timestamp-last_render_timestamp), current_timestamp);
     last_render_timestamp = current_timestamp;
+
+    // State calls this frame
+    const struct render_state_counters render_state = render_state_counters();
+    al_draw_textf(debug_font, al_map_rgb_f(0, 1, 0), 0, 30, 0, "State calls issued:%zu  skipped:%zu",
+        render_state.issued - last_render_state.issued, render_state.skipped - last_render_state.skipped);
+    last_render_state = render_state;
 #endif
 
     // Flip
@@ -493,11 +522,21 @@ int main()
         if (al_peek_next_event(main_event_queue, &current_event)
             && current_event.any.timestamp <= future_timestamp)
         {
+            al_drop_next_event(main_event_queue);
+
+            // Mouse motion only changes input state, so it doesn't need the world stepped to its timestamp
+            if (current_event.type == ALLEGRO_EVENT_MOUSE_AXES)
+            {
+                coalesce_mouse_axes();
+                process_event();
+
+                continue;
+            }
+
             future_timestamp = current_event.any.timestamp;
 
             update_and_draw(false);
             process_event();
-            al_drop_next_event(main_event_queue);
 
             continue;
         }
@@ -4,6 +4,7 @@
 
 //#include "renderer_interface.h"
 #include "material.h"
+#include "render_state.h"
 
 // To handle the varity of effect and selection data I've implemented a very basic type system.
 // Instead of having a bunch of empty fields I directly manipulate memorry to make all the data next to eachother.
@@ -89,15 +90,15 @@ void material_apply(const struct material* const material)
 {
 	if (!material)
 	{
-		al_set_shader_int("effect_id", MATERIAL_ID_NULL);
-		al_set_shader_int("selection_id", SELECTION_ID_FULL);
+		render_state_int(RENDER_STATE_UNIFORM_effect_id, MATERIAL_ID_NULL);
+		render_state_int(RENDER_STATE_UNIFORM_selection_id, SELECTION_ID_FULL);
 		return;
 	}
 
-	al_set_shader_int("effect_id", material->effect_id);
-	al_set_shader_int("selection_id", material->selection_id);
+	render_state_int(RENDER_STATE_UNIFORM_effect_id, material->effect_id);
+	render_state_int(RENDER_STATE_UNIFORM_selection_id, material->selection_id);
 
-	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+	render_state_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
 
 	const char* ptr = (const char*) material;
 	ptr += sizeof(struct material);
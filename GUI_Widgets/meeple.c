@@ -39,8 +39,11 @@ static void mask(const struct piece* const meeple)
 		0);
 }
 
+static struct widget_pool meeple_pool;
+
 static struct piece_jump_table meeple_table =
 {
+	.pool = &meeple_pool,
 	.draw = draw,
 	.mask = mask,
 	.gc = gc,
@@ -48,7 +51,7 @@ static struct piece_jump_table meeple_table =
 
 struct piece* meeple_new(lua_State* L)
 {
-	struct meeple* meeple = malloc(sizeof(struct meeple));
+	struct meeple* meeple = widget_pool_alloc(&meeple_pool, sizeof(struct meeple));
 
 	if (!meeple)
 		return NULL;
@@ -16,7 +16,8 @@ extern double delta_timestamp;
     DO(slider) \
     DO(material_test) \
     DO(dynamic_text_test) \
-    DO(text_entry)
+    DO(text_entry) \
+    DO(list_view)
 
 #define LUA_WIDGET_EXTERN(widget_interface_internal) extern int widget_interface_internal ## _new(lua_State*);
 #define LUA_REG_FUNCT(widget_interface_internal) lua_pushcfunction(L, widget_interface_internal ## _new); lua_setglobal(L, #widget_interface_internal  "_new");
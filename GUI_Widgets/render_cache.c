@@ -0,0 +1,255 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+#include "render_cache.h"
+#include "renderer_interface.h"
+#include "render_state.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <allegro5/allegro.h>
+
+extern void render_interface_cache_predraw(const struct render_interface* const, const ALLEGRO_TRANSFORM* const);
+
+#define RENDER_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define RENDER_CACHE_PADDING 4			// Local units around the bounds for strokes that straddle the edge
+#define RENDER_CACHE_RESCALE_UP 1.25	// Re-rendered when drawn this much larger than it was rendered
+#define RENDER_CACHE_RESCALE_DOWN 0.5	// Or this much smaller, to give back the memory
+
+struct render_cache
+{
+	ALLEGRO_BITMAP* bitmap; // NULL until rendered or after being evicted
+	double half_width, half_height;
+	float scale;
+	size_t bytes;
+	size_t last_used;
+	size_t idx; // Into entries
+	bool dirty;
+};
+
+static struct render_cache** entries;
+static size_t entries_used, entries_allocated;
+
+static size_t budget = RENDER_CACHE_DEFAULT_BUDGET;
+static size_t bytes_used;
+static size_t frame;
+
+// Advance the clock the least recently used caches are evicted by
+void render_cache_frame()
+{
+	frame++;
+}
+
+void render_cache_budget(size_t new_budget)
+{
+	budget = new_budget;
+}
+
+static void render_cache_evict(struct render_cache* const cache)
+{
+	if (!cache->bitmap)
+		return;
+
+	al_destroy_bitmap(cache->bitmap);
+	cache->bitmap = NULL;
+	bytes_used -= cache->bytes;
+	cache->bytes = 0;
+}
+
+// Evict the least recently composited caches until the bytes fit, ones used this frame are kept.
+static bool render_cache_make_room(size_t bytes)
+{
+	while (bytes_used + bytes > budget)
+	{
+		struct render_cache* oldest = NULL;
+
+		for (size_t i = 0; i < entries_used; i++)
+			if (entries[i]->bitmap && entries[i]->last_used != frame &&
+				(!oldest || entries[i]->last_used < oldest->last_used))
+				oldest = entries[i];
+
+		if (!oldest)
+			return false;
+
+		render_cache_evict(oldest);
+	}
+
+	return true;
+}
+
+static struct render_cache* render_cache_new()
+{
+	if (entries_allocated <= entries_used)
+	{
+		const size_t new_cnt = entries_allocated ? 2 * entries_allocated : 16;
+
+		struct render_cache** memsafe_hande = realloc(entries, new_cnt * sizeof(struct render_cache*));
+
+		if (!memsafe_hande)
+			return NULL;
+
+		entries = memsafe_hande;
+		entries_allocated = new_cnt;
+	}
+
+	struct render_cache* const cache = malloc(sizeof(struct render_cache));
+
+	if (!cache)
+		return NULL;
+
+	*cache = (struct render_cache)
+	{
+		.bitmap = NULL,
+		.idx = entries_used,
+		.dirty = true,
+	};
+
+	entries[entries_used++] = cache;
+
+	return cache;
+}
+
+// The largest scale of the world transform, so the cache is rendered at the resolution it's seen at
+static float render_cache_scale(const struct render_interface* const render_interface)
+{
+	const ALLEGRO_TRANSFORM* const transform = render_interface_world_transform(render_interface);
+
+	const float scale_x = hypotf(transform->m[0][0], transform->m[0][1]);
+	const float scale_y = hypotf(transform->m[1][0], transform->m[1][1]);
+
+	return fmaxf(scale_x, scale_y);
+}
+
+static bool render_cache_stale(const struct render_cache* const cache, const struct render_interface* const render_interface, float scale)
+{
+	return cache->dirty || !cache->bitmap ||
+		cache->half_width != render_interface->half_width ||
+		cache->half_height != render_interface->half_height ||
+		scale > cache->scale * RENDER_CACHE_RESCALE_UP ||
+		scale < cache->scale * RENDER_CACHE_RESCALE_DOWN;
+}
+
+// Make sure the cache holds the current draw, rendering it if stale. False if it couldn't be cached, then draw directly.
+//	Changes the target bitmap so it has to be called outside of drawing, the render_state is invalidated after.
+bool render_cache_prepare(struct render_cache** handle, const struct render_interface* const render_interface,
+	void (*draw)(const void*), const void* context)
+{
+	if (!*handle)
+		*handle = render_cache_new();
+
+	struct render_cache* const cache = *handle;
+
+	if (!cache)
+		return false;
+
+	const float scale = render_cache_scale(render_interface);
+
+	if (!render_cache_stale(cache, render_interface, scale))
+		return true;
+
+	const double padded_width = 2 * (render_interface->half_width + RENDER_CACHE_PADDING);
+	const double padded_height = 2 * (render_interface->half_height + RENDER_CACHE_PADDING);
+
+	const int width = (int)ceil(padded_width * scale);
+	const int height = (int)ceil(padded_height * scale);
+
+	const int max_size = al_get_display_option(al_get_current_display(), ALLEGRO_MAX_BITMAP_SIZE);
+
+	if (width <= 0 || height <= 0 || (max_size > 0 && (width > max_size || height > max_size)))
+		return false;
+
+	// Reuse the bitmap if the size holds, only the content is stale
+	if (cache->bitmap && (al_get_bitmap_width(cache->bitmap) != width || al_get_bitmap_height(cache->bitmap) != height))
+		render_cache_evict(cache);
+
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER | ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+
+	if (!cache->bitmap)
+	{
+		const size_t bytes = (size_t)width * height * 4;
+
+		if (render_cache_make_room(bytes))
+		{
+			al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR);
+			cache->bitmap = al_create_bitmap(width, height);
+		}
+
+		if (!cache->bitmap)
+		{
+			al_restore_state(&state);
+			return false;
+		}
+
+		cache->bytes = bytes;
+		bytes_used += bytes;
+	}
+
+	// The local origin is the center of the bitmap
+	ALLEGRO_TRANSFORM local;
+	al_build_transform(&local, 0.5 * width, 0.5 * height, scale, scale, 0);
+
+	al_set_target_bitmap(cache->bitmap);
+	render_state_invalidate();
+
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	render_state_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+
+	render_interface_cache_predraw(render_interface, &local);
+	draw(context);
+
+	al_restore_state(&state);
+	render_state_invalidate();
+
+	cache->half_width = render_interface->half_width;
+	cache->half_height = render_interface->half_height;
+	cache->scale = scale;
+	cache->last_used = frame;
+	cache->dirty = false;
+
+	return true;
+}
+
+// Draw the cache in place of the draw it holds, the render_interface's predraw has to be done. False if it's stale.
+bool render_cache_composite(struct render_cache* const cache, const struct render_interface* const render_interface)
+{
+	if (!cache || !cache->bitmap || cache->dirty ||
+		cache->half_width != render_interface->half_width || cache->half_height != render_interface->half_height)
+		return false;
+
+	cache->last_used = frame;
+
+	const double half_width = cache->half_width + RENDER_CACHE_PADDING;
+	const double half_height = cache->half_height + RENDER_CACHE_PADDING;
+
+	al_draw_scaled_bitmap(cache->bitmap,
+		0, 0, al_get_bitmap_width(cache->bitmap), al_get_bitmap_height(cache->bitmap),
+		-half_width, -half_height, 2 * half_width, 2 * half_height,
+		0);
+
+	return true;
+}
+
+// The next prepare re-renders
+void render_cache_invalidate(struct render_cache* const cache)
+{
+	if (cache)
+		cache->dirty = true;
+}
+
+void render_cache_release(struct render_cache** handle)
+{
+	struct render_cache* const cache = *handle;
+
+	if (!cache)
+		return;
+
+	render_cache_evict(cache);
+
+	entries[cache->idx] = entries[--entries_used];
+	entries[cache->idx]->idx = cache->idx;
+
+	free(cache);
+	*handle = NULL;
+}
@@ -0,0 +1,23 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct render_interface;
+struct render_cache;
+
+// Retained drawing, a draw is rendered once into an offscreen bitmap and composited until it's invalidated.
+//	Caches are re-rendered when invalidated, resized or scaled up past their resolution.
+//	Their bitmaps share a memory budget, past it the least recently composited are evicted.
+//	Anything animated in the shader is frozen in the cache, so only opt in static drawing.
+
+void render_cache_frame();
+void render_cache_budget(size_t);
+
+bool render_cache_prepare(struct render_cache**, const struct render_interface* const, void (*)(const void*), const void*);
+bool render_cache_composite(struct render_cache* const, const struct render_interface* const);
+void render_cache_invalidate(struct render_cache* const);
+void render_cache_release(struct render_cache**);
@@ -0,0 +1,256 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+#include "render_state.h"
+
+#include <string.h>
+#include <allegro5/allegro_opengl.h>
+
+// Only touched by the main thread while drawing, so no locking.
+
+#define RENDER_STATE_VECTOR_MAX 16 // Enough for a keyframe segment
+
+#define _RENDER_STATE_UNIFORM_NAME(uniform) #uniform,
+
+static const char* const uniform_names[] =
+{
+	FOR_RENDER_STATE_UNIFORMS(_RENDER_STATE_UNIFORM_NAME)
+};
+
+struct uniform_shadow
+{
+	bool valid;
+	int components; // 0 for ints and bools
+	union
+	{
+		int i;
+		float f[RENDER_STATE_VECTOR_MAX];
+	};
+};
+
+static struct uniform_shadow uniforms[RENDER_STATE_UNIFORM_CNT];
+
+static ALLEGRO_SHADER* shader;
+static bool shader_valid;
+
+static int blender[3];
+static bool blender_valid;
+
+static bool stencil_test;
+static bool stencil_test_valid;
+
+static bool depth_test;
+static bool depth_test_valid;
+
+static bool depth_write;
+static bool depth_write_valid;
+
+static int alpha_test_function;
+static int alpha_test_value;
+static bool alpha_test_valid;
+
+static ALLEGRO_TRANSFORM transform;
+static bool transform_valid;
+
+static struct render_state_counters counters;
+
+// Count the call, true if it has to be issued
+static inline bool issue(bool unchanged)
+{
+	if (unchanged)
+	{
+		counters.skipped++;
+		return false;
+	}
+
+	counters.issued++;
+	return true;
+}
+
+static void invalidate_uniforms()
+{
+	for (size_t i = 0; i < RENDER_STATE_UNIFORM_CNT; i++)
+		uniforms[i].valid = false;
+}
+
+// Forget everything, the next call to each setter is issued
+void render_state_invalidate()
+{
+	invalidate_uniforms();
+
+	shader_valid = false;
+	blender_valid = false;
+	stencil_test_valid = false;
+	depth_test_valid = false;
+	depth_write_valid = false;
+	alpha_test_valid = false;
+	transform_valid = false;
+}
+
+// Uniforms belong to the shader, so they are forgotten when it changes
+void render_state_use_shader(ALLEGRO_SHADER* new_shader)
+{
+	if (!issue(shader_valid && shader == new_shader))
+		return;
+
+	al_use_shader(new_shader);
+
+	shader = new_shader;
+	shader_valid = true;
+
+	invalidate_uniforms();
+}
+
+void render_state_int(enum RENDER_STATE_UNIFORM uniform, int value)
+{
+	struct uniform_shadow* const shadow = uniforms + uniform;
+
+	if (!issue(shadow->valid && shadow->i == value))
+		return;
+
+	al_set_shader_int(uniform_names[uniform], value);
+
+	*shadow = (struct uniform_shadow){ .valid = true, .components = 0, .i = value };
+}
+
+void render_state_bool(enum RENDER_STATE_UNIFORM uniform, bool value)
+{
+	struct uniform_shadow* const shadow = uniforms + uniform;
+
+	if (!issue(shadow->valid && shadow->i == value))
+		return;
+
+	al_set_shader_bool(uniform_names[uniform], value);
+
+	*shadow = (struct uniform_shadow){ .valid = true, .components = 0, .i = value };
+}
+
+void render_state_float(enum RENDER_STATE_UNIFORM uniform, float value)
+{
+	render_state_float_vector(uniform, 1, &value);
+}
+
+// Only a single vector of at most RENDER_STATE_VECTOR_MAX components is shadowed
+void render_state_float_vector(enum RENDER_STATE_UNIFORM uniform, int components, const float* values)
+{
+	struct uniform_shadow* const shadow = uniforms + uniform;
+
+	if (!issue(shadow->valid && shadow->components == components &&
+		0 == memcmp(shadow->f, values, components * sizeof(float))))
+		return;
+
+	if (components == 1)
+		al_set_shader_float(uniform_names[uniform], *values);
+	else
+		al_set_shader_float_vector(uniform_names[uniform], components, values, 1);
+
+	shadow->valid = components <= RENDER_STATE_VECTOR_MAX;
+	shadow->components = components;
+
+	if (shadow->valid)
+		memcpy(shadow->f, values, components * sizeof(float));
+}
+
+// A float array uniform, like float_vector only arrays of at most RENDER_STATE_VECTOR_MAX are shadowed
+void render_state_float_array(enum RENDER_STATE_UNIFORM uniform, int elements, const float* values)
+{
+	struct uniform_shadow* const shadow = uniforms + uniform;
+
+	if (!issue(shadow->valid && shadow->components == elements &&
+		0 == memcmp(shadow->f, values, elements * sizeof(float))))
+		return;
+
+	al_set_shader_float_vector(uniform_names[uniform], 1, values, elements);
+
+	shadow->valid = elements <= RENDER_STATE_VECTOR_MAX;
+	shadow->components = elements;
+
+	if (shadow->valid)
+		memcpy(shadow->f, values, elements * sizeof(float));
+}
+
+void render_state_blender(int op, int src, int dst)
+{
+	if (!issue(blender_valid && blender[0] == op && blender[1] == src && blender[2] == dst))
+		return;
+
+	al_set_blender(op, src, dst);
+
+	blender[0] = op, blender[1] = src, blender[2] = dst;
+	blender_valid = true;
+}
+
+void render_state_stencil_test(bool enable)
+{
+	if (!issue(stencil_test_valid && stencil_test == enable))
+		return;
+
+	if (enable)
+		glEnable(GL_STENCIL_TEST);
+	else
+		glDisable(GL_STENCIL_TEST);
+
+	stencil_test = enable;
+	stencil_test_valid = true;
+}
+
+// Later draws win ties so a widget can paint over itself
+void render_state_depth_test(bool enable)
+{
+	if (!issue(depth_test_valid && depth_test == enable))
+		return;
+
+	if (enable)
+	{
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+	}
+	else
+		glDisable(GL_DEPTH_TEST);
+
+	depth_test = enable;
+	depth_test_valid = true;
+}
+
+void render_state_depth_write(bool enable)
+{
+	if (!issue(depth_write_valid && depth_write == enable))
+		return;
+
+	glDepthMask(enable ? GL_TRUE : GL_FALSE);
+
+	depth_write = enable;
+	depth_write_valid = true;
+}
+
+// One of ALLEGRO_RENDER_FUNCTION, compared against an alpha value from 0 to 255
+void render_state_alpha_test(int function, int value)
+{
+	if (!issue(alpha_test_valid && alpha_test_function == function && alpha_test_value == value))
+		return;
+
+	al_set_render_state(ALLEGRO_ALPHA_FUNCTION, function);
+	al_set_render_state(ALLEGRO_ALPHA_TEST_VALUE, value);
+
+	alpha_test_function = function;
+	alpha_test_value = value;
+	alpha_test_valid = true;
+}
+
+// Compared by value, render_interfaces sharing a world transform don't re-upload it
+void render_state_transform(const ALLEGRO_TRANSFORM* const new_transform)
+{
+	if (!issue(transform_valid && 0 == memcmp(&transform, new_transform, sizeof(ALLEGRO_TRANSFORM))))
+		return;
+
+	al_use_transform(new_transform);
+
+	transform = *new_transform;
+	transform_valid = true;
+}
+
+struct render_state_counters render_state_counters()
+{
+	return counters;
+}
@@ -0,0 +1,56 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+#pragma once
+
+#include <allegro5/allegro.h>
+#include <stdbool.h>
+
+// A thin shadow of the GL state set while drawing.
+//	Each setter compares against the last value it issued and skips the driver call if nothing changed.
+//	Anything that changes the state behind its back (a new target bitmap or shader, raw GL) has to call render_state_invalidate.
+
+#define FOR_RENDER_STATE_UNIFORMS(DO) \
+	DO(variation) \
+	DO(object_scale) \
+	DO(current_timestamp) \
+	DO(gpu_keyframe) \
+	DO(keyframe_segment) \
+	DO(keyframe_blend) \
+	DO(effect_id) \
+	DO(selection_id) \
+	DO(depth)
+
+#define _RENDER_STATE_UNIFORM_ENUM(uniform) RENDER_STATE_UNIFORM_ ## uniform,
+
+enum RENDER_STATE_UNIFORM
+{
+	FOR_RENDER_STATE_UNIFORMS(_RENDER_STATE_UNIFORM_ENUM)
+
+	RENDER_STATE_UNIFORM_CNT
+};
+
+// Running totals of the driver calls made and avoided
+struct render_state_counters
+{
+	size_t issued;
+	size_t skipped;
+};
+
+void render_state_invalidate();
+void render_state_use_shader(ALLEGRO_SHADER*);
+
+void render_state_int(enum RENDER_STATE_UNIFORM, int);
+void render_state_bool(enum RENDER_STATE_UNIFORM, bool);
+void render_state_float(enum RENDER_STATE_UNIFORM, float);
+void render_state_float_vector(enum RENDER_STATE_UNIFORM, int, const float*);
+void render_state_float_array(enum RENDER_STATE_UNIFORM, int, const float*);
+
+void render_state_blender(int, int, int);
+void render_state_stencil_test(bool);
+void render_state_depth_test(bool);
+void render_state_depth_write(bool);
+void render_state_alpha_test(int, int);
+void render_state_transform(const ALLEGRO_TRANSFORM* const);
+
+struct render_state_counters render_state_counters();
@@ -7,9 +7,12 @@
 #include "tweener.h"
 #include "material.h"
 #include "camera.h"
+#include "render_state.h"
+#include "sprite_batch.h"
 
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include <allegro5/allegro_opengl.h>
 
 extern void camera_init();
@@ -19,16 +22,51 @@ extern double current_timestamp;
 
 static ALLEGRO_SHADER* shader;
 
+// Animation level of detail, render_interfaces that were off screen, only a few pixels big or not drawn at all last frame
+//	are blended at a reduced rate. Paths about to end are still blended on time so callbacks don't drift.
+#define LOD_PERIOD 0.1
+#define LOD_MIN_PIXELS 2.0
+
+static float display_width, display_height;
+
+static void animation_clip_init();
+
 struct render_interface_internal
 {
 	struct render_interface;
 	struct tweener* keyframe_tweener;
 	double variation;
+	double lod_timestamp;
+	bool lod_reduced;
+	bool gpu_keyframes;
+	size_t children;	// Render_interfaces with this as their parent
+
+	// The GPU evaluated segment as the shader reads it, only converted when the segment changes.
+	//	The timestamps stay on the CPU, the shader is only sent the blend.
+	float gpu_segment[2 * KEYFRAME_MEMBER_CNT];
+	double gpu_segment_timestamps[2];
+
+	// The world transform and its inverse, only rebuilt when stale, see render_interface_world_transform
+	ALLEGRO_TRANSFORM world, world_inverse;
+	size_t world_version;	// Advances with each rebuild so children notice
+	size_t parent_version;	// The parent's world_version it was built against
+	size_t camera_version;	// The camera_version it was built against
+	bool world_dirty;		// Set whenever current is written
+	bool inverse_dirty;
 };
 
-static struct render_interface_internal* list;
-static size_t allocated;
+// Render_interfaces are handed out as pointers, so they're kept in fixed size chunks that never move as the list grows
+#define RENDER_INTERFACE_CHUNK 256
+
+static struct render_interface_internal** chunks;
+static size_t chunks_used, chunks_allocated;
 static size_t used;
+static struct render_interface_internal** free_list; // Released render_interfaces, reused before the list grows
+static size_t free_used, free_allocated;
+static size_t camera_version; // Advances when the camera moves, see camera_version_update
+static struct keyframe camera_seen;
+static size_t revision; // Advances whenever a current keyframe might have changed
+static size_t gpu_moving; // Render_interfaces whose current keyframe lags a GPU evaluated segment, see render_interface_sync
 
 #ifdef _CHECK_KEYFRAME_DEBUG
 static void assert_current_keyframe_nan(struct render_interface* render)
@@ -72,6 +110,9 @@ static inline int make_shader()
 	ALLEGRO_DISPLAY* const display = al_get_current_display();
 	const float dimensions[2] = { al_get_display_width(display),al_get_display_height(display) };
 
+	display_width = dimensions[0];
+	display_height = dimensions[1];
+
 	al_use_shader(shader);
 	al_set_shader_float_vector("display_dimensions", 2, dimensions, 1);
 	al_use_shader(NULL);
@@ -79,72 +120,208 @@ static inline int make_shader()
 	return 1;
 }
 
+static inline struct render_interface_internal* render_interface_at(size_t idx)
+{
+	return chunks[idx / RENDER_INTERFACE_CHUNK] + idx % RENDER_INTERFACE_CHUNK;
+}
+
+// Add a chunk to the list
+static bool render_interface_grow()
+{
+	if (chunks_allocated <= chunks_used)
+	{
+		const size_t new_cnt = chunks_allocated ? 2 * chunks_allocated : 16;
+
+		struct render_interface_internal** memsafe_hande = realloc(chunks, new_cnt * sizeof(struct render_interface_internal*));
+
+		if (!memsafe_hande)
+			return false;
+
+		chunks = memsafe_hande;
+		chunks_allocated = new_cnt;
+	}
+
+	struct render_interface_internal* const chunk = malloc(RENDER_INTERFACE_CHUNK * sizeof(struct render_interface_internal));
+
+	if (!chunk)
+		return false;
+
+	chunks[chunks_used++] = chunk;
+
+	return true;
+}
+
 void render_interface_init()
 {
 	used = 0;
-	allocated = 100;
-	list = malloc(allocated * sizeof(struct render_interface_internal));
+	render_interface_grow();
 
 	make_shader();
+	sprite_batch_init();
 	camera_init();
+	animation_clip_init();
 }
 
 struct render_interface* render_interface_new(size_t hint)
 {
-	if (allocated <= used)
-	{
-		const size_t new_cnt = 2 * allocated;
-
-		struct render_interface_internal* memsafe_hande = realloc(list, new_cnt * sizeof(struct render_interface_internal));
+	struct render_interface_internal* render_interface;
 
-		if (!memsafe_hande)
+	// Released render_interfaces keep their tweener, so reusing one doesn't allocate
+	if (free_used)
+	{
+		render_interface = free_list[--free_used];
+	}
+	else
+	{
+		if (chunks_used * RENDER_INTERFACE_CHUNK <= used && !render_interface_grow())
 			return NULL;
 
-		list = memsafe_hande;
-		allocated = new_cnt;
-	}
+		render_interface = render_interface_at(used++);
 
-	struct render_interface_internal* render_interface = list + used++;
+		if (hint < 1)
+			hint = 1;
 
-	if (hint < 1)
-		hint = 1;
+		render_interface->keyframe_tweener = tweener_new(KEYFRAME_MEMBER_CNT, hint);
+		tweener_set_owned(render_interface->keyframe_tweener, true);
+	}
 
-	render_interface->keyframe_tweener = tweener_new(KEYFRAME_MEMBER_CNT, hint);
 	render_interface->variation = fmod(current_timestamp, 100);
 	render_interface->half_width = 0;
 	render_interface->half_height = 0;
+	render_interface->parent = NULL;
+	render_interface->world_dirty = true;
+	render_interface->inverse_dirty = true;
+	render_interface->lod_timestamp = current_timestamp;
+	render_interface->lod_reduced = false;
+	render_interface->gpu_keyframes = false;
+	render_interface->children = 0;
+	render_interface->gpu_segment_timestamps[0] = NAN;
 
 	return (struct render_interface*)render_interface;
 }
 
+// Make room for cnt more render interfaces, and their tweeners, so bulk construction allocates up front.
+void render_interface_reserve(size_t cnt)
+{
+	// Released render_interfaces are reused first
+	cnt = cnt > free_used ? cnt - free_used : 0;
+
+	tweener_pool_reserve(cnt);
+
+	while (chunks_used * RENDER_INTERFACE_CHUNK < used + cnt)
+		if (!render_interface_grow())
+			return;
+}
+
+// Hand a render_interface back for reuse, its tweener is reset so updates skip it until then.
+void render_interface_release(struct render_interface* const render_interface)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
+
+	if (free_allocated <= free_used)
+	{
+		const size_t new_cnt = free_allocated ? 2 * free_allocated : 64;
+
+		struct render_interface_internal** memsafe_hande = realloc(free_list, new_cnt * sizeof(struct render_interface_internal*));
+
+		if (!memsafe_hande)
+			return;
+
+		free_list = memsafe_hande;
+		free_allocated = new_cnt;
+	}
+
+	tweener_recycle(internal->keyframe_tweener);
+	internal->gpu_keyframes = false;
+
+	free_list[free_used++] = internal;
+}
+
 void render_interface_enter_loop(struct render_interface* const render_interface, double looping_offset)
 {
 	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
 	tweener_enter_loop(internal->keyframe_tweener, looping_offset);
 }
 
-static void render_interface_update_work(struct render_interface_internal* render_interface)
+// The timeless keyframe members are contiguous doubles in channel order, so the tweener can blend straight into them.
+static inline double* keyframe_channels(struct keyframe* const keyframe)
 {
-	double* keypoint = render_interface->keyframe_tweener->current;
+	return &keyframe->x;
+}
 
-#define _KEYFRAME_COPY_KP_CU(X,IDX,...) render_interface->current.## X = keypoint[IDX-1];
-	FOR_KEYFRAME_MEMBERS_TIMELESS(_KEYFRAME_COPY_KP_CU)
+static void render_interface_update_work(struct render_interface_internal* render_interface)
+{
+	tweener_blend(render_interface->keyframe_tweener, keyframe_channels(&render_interface->current));
+	render_interface->world_dirty = true;
 
 	CHECK_NON_NAN_CURRENT_FRAME((struct render_interface*) render_interface)
 }
 
+// Whether the keyframes are blended in the shader right now, if so start and end are the segment.
+//	The shader only knows the camera, so anything in a hierarchy is blended on the CPU.
+//	Children need their parent's world transform and parents have to keep theirs current for their children.
+static inline bool render_interface_gpu_segment(const struct render_interface_internal* const render_interface,
+	const double** start, const double** end)
+{
+	return render_interface->gpu_keyframes && !render_interface->parent && !render_interface->children &&
+		tweener_linear_segment(render_interface->keyframe_tweener, start, end);
+}
+
+// Whether a reduced render_interface can wait for a later update.
+//	A GPU evaluated segment only needs the CPU once it ends, but current is still refreshed for picking.
+static inline bool render_interface_lod_skip(const struct render_interface_internal* const render_interface)
+{
+	if (current_timestamp - render_interface->lod_timestamp >= LOD_PERIOD)
+		return false;
+
+	const double* start;
+	const double* end;
+
+	if (render_interface_gpu_segment(render_interface, &start, &end))
+		return end[0] >= current_timestamp;
+
+	return render_interface->lod_reduced &&
+		tweener_end_timestamp(render_interface->keyframe_tweener) >= current_timestamp;
+}
+
+// Blend the keyframe tweeners of all render_interfaces that are currently moving.
+// (The keyframe tweeners are owned so this is the only pass they get.)
 struct work_queue* render_interface_update()
 {
 	struct work_queue* work_queue = work_queue_create();
 
-	for(struct render_interface_internal* p = list;
-		p != (used ? list + used : list);
-		p++)
-		work_queue_push(work_queue, render_interface_update_work, p);
+	gpu_moving = 0;
+
+	for (size_t i = 0; i < used; i++)
+	{
+		struct render_interface_internal* const p = render_interface_at(i);
+
+		if (!tweener_is_active(p->keyframe_tweener))
+			continue;
+
+		const double* start;
+		const double* end;
+
+		if (render_interface_gpu_segment(p, &start, &end) && end[0] >= current_timestamp)
+			gpu_moving++;
+
+		if (!render_interface_lod_skip(p))
+		{
+			p->lod_timestamp = current_timestamp;
+			work_queue_push(work_queue, render_interface_update_work, p);
+			revision++;
+		}
+	}
 
 	return work_queue;
 }
 
+// Lets consumers of the current keyframes (like picking) skip work when nothing moved.
+size_t render_interface_revision()
+{
+	return revision;
+}
+
 void render_interface_set(struct render_interface* const render_interface, struct keyframe* const set)
 {
 	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
@@ -153,6 +330,8 @@ void render_interface_set(struct render_interface* const render_interface, struc
 	tweener_set(tweener, (double[]) { set->x, set->y, set->sx, set->sy, set->theta , set->camera, set->dx, set->dy});
 
 	memcpy(&render_interface->current, set, sizeof(struct keyframe));  // maybe can be optimized out
+	internal->world_dirty = true;
+	revision++;
 
 	CHECK_NON_NAN_CURRENT_FRAME(render_interface)
 }
@@ -169,6 +348,7 @@ void render_interface_push_keyframe(struct render_interface* const render_interf
 {
 	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
 	double* new_point = tweener_new_point(internal->keyframe_tweener);
+	internal->gpu_segment_timestamps[0] = NAN;
 
 #define _KEYFRAME_COPY_FR_NP(X,IDX,...) new_point[IDX] = frame->## X ;
 	FOR_KEYFRAME_MEMBERS(_KEYFRAME_COPY_FR_NP)
@@ -184,14 +364,91 @@ void render_interface_copy_destination(struct render_interface* const render_int
 	FOR_KEYFRAME_MEMBERS(_KEYFRAME_COPY_NP_FR)
 }
 
+// Play a shared clip with the given offset and scale keyframes (either can be NULL).
+void render_interface_play_clip(struct render_interface* const render_interface, struct tweener_clip* clip,
+	double start, struct keyframe* offset, struct keyframe* scale)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
+	struct tweener* const tweener = internal->keyframe_tweener;
+
+	internal->gpu_segment_timestamps[0] = NAN;
+
+	tweener_play_clip(tweener, clip, start,
+		offset ? keyframe_channels(offset) : NULL,
+		scale ? keyframe_channels(scale) : NULL);
+
+	// A single keypoint clip is just a set
+	if (!tweener_is_active(tweener))
+	{
+		memcpy(keyframe_channels(&render_interface->current), tweener->current, KEYFRAME_MEMBER_CNT * sizeof(double));
+		internal->world_dirty = true;
+		revision++;
+	}
+}
+
+// Opt in to having the shader blend the keyframes, for large numbers of simply animated widgets.
+//	Only linear segments outside a parent and child hierarchy are evaluated on the GPU, the rest fall back to the CPU blend.
+//	The widget's draw must not set its own transform.
+void render_interface_gpu_keyframes(struct render_interface* const render_interface, bool gpu_keyframes)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
+
+	internal->gpu_keyframes = gpu_keyframes;
+}
+
+// How many render_interfaces were mid GPU evaluated segment at the last update, their current keyframes lag what's drawn.
+size_t render_interface_gpu_moving()
+{
+	return gpu_moving;
+}
+
+// The keyframe the GPU evaluated segment ends at, false if the render_interface isn't being evaluated on the GPU.
+//	Together with current it bounds where the render_interface is drawn.
+bool render_interface_gpu_destination(const struct render_interface* const render_interface, struct keyframe* const keyframe)
+{
+	const struct render_interface_internal* const internal = (const struct render_interface_internal*)render_interface;
+
+	const double* start;
+	const double* end;
+
+	if (!render_interface_gpu_segment(internal, &start, &end) || end[0] < current_timestamp)
+		return false;
+
+	*keyframe = render_interface->current;
+	keyframe->timestamp = end[0];
+	memcpy(keyframe_channels(keyframe), end + 1, KEYFRAME_MEMBER_CNT * sizeof(double));
+
+	return true;
+}
+
+// Blend the current keyframe now if it lags a GPU evaluated segment, for when it has to match what's drawn (like picking).
+//	Only call it from the main thread outside of the update.
+void render_interface_sync(struct render_interface* const render_interface)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal*)render_interface;
+
+	const double* start;
+	const double* end;
+
+	if (internal->lod_timestamp == current_timestamp || !render_interface_gpu_segment(internal, &start, &end))
+		return;
+
+	internal->lod_timestamp = current_timestamp;
+	render_interface_update_work(internal);
+	revision++;
+}
+
 void render_interface_interupt(struct render_interface* const render_interface)
 {
 	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
 
 	tweener_interupt(internal->keyframe_tweener);
+	internal->gpu_segment_timestamps[0] = NAN;
 
 #define _KEYFRAME_COPY_CR_TW(X,IDX,...) render_interface->current.## X = internal->keyframe_tweener->current[IDX-1];
 	FOR_KEYFRAME_MEMBERS_TIMELESS(_KEYFRAME_COPY_CR_TW)
+	internal->world_dirty = true;
+	revision++;
 
 	CHECK_NON_NAN_CURRENT_FRAME(render_interface)
 }
@@ -218,42 +475,316 @@ void keyframe_default(struct keyframe* const keyframe)
 	};
 }
 
+// Advance camera_version if the camera moved since it was last checked
+static void camera_version_update()
+{
+	struct keyframe camera;
+	camera_copy_current(&camera);
+
+	if (camera.x != camera_seen.x || camera.y != camera_seen.y ||
+		camera.sx != camera_seen.sx || camera.sy != camera_seen.sy || camera.theta != camera_seen.theta)
+	{
+		camera_seen = camera;
+		camera_version++;
+	}
+}
+
+// Rebuild the world transform if the keyframe, the parent's world transform or (for roots) the camera changed.
+//	A child's camera blend is ignored since the root's camera blend already applies to the whole tree,
+//	its dx and dy are still a screen space offset.
+static void world_refresh(struct render_interface_internal* const render_interface)
+{
+	struct render_interface_internal* const parent = (struct render_interface_internal*)render_interface->parent;
+
+	bool stale = render_interface->world_dirty;
+
+	if (parent)
+	{
+		world_refresh(parent);
+		stale |= parent->world_version != render_interface->parent_version;
+	}
+	else if (render_interface->current.camera >= 0.0)
+		stale |= camera_version != render_interface->camera_version;
+
+	if (!stale)
+		return;
+
+	const struct keyframe* const keyframe = &render_interface->current;
+
+	if (parent)
+	{
+		al_build_transform(&render_interface->world,
+			keyframe->x, keyframe->y,
+			keyframe->sx, keyframe->sy,
+			keyframe->theta);
+
+		al_compose_transform(&render_interface->world, &parent->world);
+		al_translate_transform(&render_interface->world, keyframe->dx, keyframe->dy);
+
+		render_interface->parent_version = parent->world_version;
+	}
+	else
+		keyframe_build_transform(keyframe, &render_interface->world);
+
+	render_interface->camera_version = camera_version;
+	render_interface->world_version++;
+	render_interface->world_dirty = false;
+	render_interface->inverse_dirty = true;
+}
+
+// Bring every stale world transform up to date, once a frame after the keyframes are blended.
+//	Afterwards the widget updates on the thread pool can read them through render_interface_world_cached.
+void render_interface_refresh_transforms()
+{
+	camera_version_update();
+
+	for (size_t i = 0; i < used; i++)
+		world_refresh(render_interface_at(i));
+}
+
+// The render_interface's transform, composed with its parents'.
+//	Cached until the keyframe, a parent or the camera moves. Main thread only, it rebuilds stale transforms.
+const ALLEGRO_TRANSFORM* render_interface_world_transform(const struct render_interface* const render_interface)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal*)render_interface;
+
+	camera_version_update();
+	world_refresh(internal);
+
+	return &internal->world;
+}
+
+// The inverse of render_interface_world_transform, only inverted when the world transform changes.
+//	Allegro's inverse only handles 2D transforms, which is all a keyframe can build.
+const ALLEGRO_TRANSFORM* render_interface_world_inverse(const struct render_interface* const render_interface)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal*)render_interface;
+
+	render_interface_world_transform(render_interface);
+
+	if (internal->inverse_dirty)
+	{
+		al_copy_transform(&internal->world_inverse, &internal->world);
+		al_invert_transform(&internal->world_inverse);
+		internal->inverse_dirty = false;
+	}
+
+	return &internal->world_inverse;
+}
+
+// Read only versions of the world transform and its inverse for the thread pool, nothing shared is written.
+//	They hold the transforms as of the last render_interface_refresh_transforms, the inverse is worked out into inverse if it isn't cached.
+const ALLEGRO_TRANSFORM* render_interface_world_cached(const struct render_interface* const render_interface,
+	ALLEGRO_TRANSFORM* const inverse)
+{
+	const struct render_interface_internal* const internal = (const struct render_interface_internal*)render_interface;
+
+	if (inverse)
+	{
+		if (internal->inverse_dirty)
+		{
+			al_copy_transform(inverse, &internal->world);
+			al_invert_transform(inverse);
+		}
+		else
+			al_copy_transform(inverse, &internal->world_inverse);
+	}
+
+	return &internal->world;
+}
+
+// Make current relative to the parent's transform, NULL makes it relative to the screen again.
+void render_interface_set_parent(struct render_interface* const render_interface, const struct render_interface* const parent)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal*)render_interface;
+
+	if (render_interface->parent)
+		((struct render_interface_internal*)render_interface->parent)->children--;
+
+	if (parent)
+		((struct render_interface_internal*)parent)->children++;
+
+	render_interface->parent = parent;
+	internal->world_dirty = true;
+}
+
 void render_interface_global_predraw()
 {
-	al_use_shader(shader);
-	glDisable(GL_STENCIL_TEST);
-	al_set_shader_float("current_timestamp", current_timestamp);
+	render_state_use_shader(shader);
+	render_state_stencil_test(false);
+
+	render_state_bool(RENDER_STATE_UNIFORM_gpu_keyframe, false);
+	render_state_float(RENDER_STATE_UNIFORM_current_timestamp, current_timestamp);
+	render_state_float(RENDER_STATE_UNIFORM_depth, 0);
 	camera_global_predraw();
 }
 
 void render_interface_use_transform(const struct render_interface* const render_interface)
 {
-	//TODO probably make a global for some perfonacne.
-	//		Thread safty?
+	render_state_transform(render_interface_world_transform(render_interface));
+}
+
+// The screen space bounding box of the render_interface, false if it has no dimensions to measure.
+static bool render_interface_screen_bounds(const struct render_interface* const render_interface,
+	float* const min_x, float* const min_y, float* const max_x, float* const max_y)
+{
+	const float half_width = render_interface->half_width;
+	const float half_height = render_interface->half_height;
+
+	if (half_width == 0 || half_height == 0)
+		return false;
+
+	const ALLEGRO_TRANSFORM* const transform = render_interface_world_transform(render_interface);
+
+	float x[4] = { -half_width, half_width, half_width, -half_width };
+	float y[4] = { -half_height, -half_height, half_height, half_height };
+
+	*min_x = FLT_MAX, *min_y = FLT_MAX;
+	*max_x = -FLT_MAX, *max_y = -FLT_MAX;
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		al_transform_coordinates(transform, x + i, y + i);
+
+		*min_x = fminf(*min_x, x[i]), *max_x = fmaxf(*max_x, x[i]);
+		*min_y = fminf(*min_y, y[i]), *max_y = fmaxf(*max_y, y[i]);
+	}
+
+	return true;
+}
+
+// Whether the render_interface's bounds are entirely off screen, never true without dimensions.
+bool render_interface_off_screen(const struct render_interface* const render_interface)
+{
+	float min_x, min_y, max_x, max_y;
+
+	if (!render_interface_screen_bounds(render_interface, &min_x, &min_y, &max_x, &max_y))
+		return false;
+
+	return max_x < 0 || max_y < 0 || min_x > display_width || min_y > display_height;
+}
+
+// Classify the render_interface for the animation level of detail by its on screen bounding box.
+//	Without dimensions there is nothing to measure so it stays at the full rate.
+static void render_interface_lod_classify(struct render_interface_internal* const render_interface)
+{
+	float min_x, min_y, max_x, max_y;
+
+	if (!render_interface_screen_bounds((struct render_interface*)render_interface, &min_x, &min_y, &max_x, &max_y))
+	{
+		render_interface->lod_reduced = false;
+		return;
+	}
+
+	const bool off_screen = max_x < 0 || max_y < 0 || min_x > display_width || min_y > display_height;
+	const bool tiny = max_x - min_x < LOD_MIN_PIXELS && max_y - min_y < LOD_MIN_PIXELS;
+
+	render_interface->lod_reduced = off_screen || tiny;
+}
+
+// For render_interfaces that won't be drawn (like hidden or culled widgets), they're classified again once drawn.
+void render_interface_lod_unseen(struct render_interface* const render_interface)
+{
+	((struct render_interface_internal*)render_interface)->lod_reduced = true;
+}
+
+// The uniforms that belong to the render_interface rather than the frame
+static void render_interface_predraw_uniforms(const struct render_interface_internal* const internal)
+{
+	//al_set_shader_float("saturate", render_interface->current.saturate);
+	render_state_float(RENDER_STATE_UNIFORM_variation, internal->variation);
 
-	ALLEGRO_TRANSFORM buffer;
-	keyframe_build_transform(&render_interface->current, &buffer);
-	al_use_transform(&buffer);
+	// Widgets of the same size share a scale, so it's only sent when it changes
+	if (internal->half_width != 0 && internal->half_height != 0)
+	{
+		const float dimensions[2] = { 1.0 / internal->half_width, 1.0 / internal->half_height };
+		render_state_float_vector(RENDER_STATE_UNIFORM_object_scale, 2, dimensions);
+	}
+}
+
+// The predraw for drawing into a render cache, the local coordinates go through the given transform instead of the world transform.
+//	The target bitmap is fresh so the frame's state is set up as well.
+void render_interface_cache_predraw(const struct render_interface* const render_interface, const ALLEGRO_TRANSFORM* const local)
+{
+	render_state_use_shader(shader);
+	render_state_stencil_test(false);
+	render_state_depth_test(false);
+
+	render_state_bool(RENDER_STATE_UNIFORM_gpu_keyframe, false);
+	render_state_float(RENDER_STATE_UNIFORM_current_timestamp, current_timestamp);
+	render_state_float(RENDER_STATE_UNIFORM_depth, 0);
+
+	render_interface_predraw_uniforms((const struct render_interface_internal*)render_interface);
+	render_state_transform(local);
+
+	material_apply(NULL);
+}
+
+// The predraw for render_interfaces drawn through the sprite batch, which reads the world transform instead.
+//	False if the keyframes are blended in the shader, those have to go through render_interface_predraw.
+bool render_interface_batched_predraw(const struct render_interface* const render_interface)
+{
+	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
+
+	const double* start;
+	const double* end;
+
+	if (render_interface_gpu_segment(internal, &start, &end))
+		return false;
+
+	render_interface_lod_classify(internal);
+
+	return true;
 }
 
 void render_interface_predraw(const struct render_interface* const render_interface)
 {
 	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
 
-	//al_set_shader_float("saturate", render_interface->current.saturate);
-	al_set_shader_float("variation", internal->variation);
+	render_interface_lod_classify(internal);
+	render_interface_predraw_uniforms(internal);
 
-	// You don't actually have to send this everytime, should track a count of materials that need it.
-	if (render_interface->half_width != 0 && render_interface->half_height != 0)
+	// Upload the segment and let the shader blend it
+	const double* start;
+	const double* end;
+
+	if (render_interface_gpu_segment(internal, &start, &end))
+	{
+		// Segments of a path are told apart by their timestamps, changing the path clears them
+		if (internal->gpu_segment_timestamps[0] != start[0] || internal->gpu_segment_timestamps[1] != end[0])
+		{
+			for (size_t i = 0; i < KEYFRAME_MEMBER_CNT; i++)
+			{
+				internal->gpu_segment[i] = start[i + 1];
+				internal->gpu_segment[KEYFRAME_MEMBER_CNT + i] = end[i + 1];
+			}
+
+			internal->gpu_segment_timestamps[0] = start[0];
+			internal->gpu_segment_timestamps[1] = end[0];
+		}
+
+		// Blended in double so the shader never sees a timestamp that loses precision as the session runs
+		const double duration = end[0] - start[0];
+		const double blend = duration > 0 ? fmin(fmax((current_timestamp - start[0]) / duration, 0), 1) : 1;
+
+		render_state_float_array(RENDER_STATE_UNIFORM_keyframe_segment, 2 * KEYFRAME_MEMBER_CNT, internal->gpu_segment);
+		render_state_float(RENDER_STATE_UNIFORM_keyframe_blend, blend);
+
+		render_state_bool(RENDER_STATE_UNIFORM_gpu_keyframe, true);
+
+		ALLEGRO_TRANSFORM identity;
+		al_identity_transform(&identity);
+		render_state_transform(&identity);
+	}
+	else
 	{
-		const float dimensions[2] = { 1.0 / render_interface->half_width, 1.0 / render_interface->half_height };
-		al_set_shader_float_vector("object_scale", 2, dimensions, 1);
+		render_state_bool(RENDER_STATE_UNIFORM_gpu_keyframe, false);
+		render_interface_use_transform(render_interface);
 	}
 
-	render_interface_use_transform(render_interface);
 	material_apply(NULL);
 
-	glDisable(GL_STENCIL_TEST);
+	render_state_stencil_test(false);
 }
 
 #include "lua/lua.h"
@@ -290,3 +821,167 @@ void lua_pushkeyframe(struct lua_State* L, const struct keyframe* const keyframe
 #define WRITE(member,...) lua_pushstring(L, #member); lua_pushnumber(L, keyframe-> ## member); lua_settable(L,-(3));
 	FOR_KEYFRAME_MEMBERS(WRITE)
 }
+
+// Animation clips are shared keyframe paths, build them once and play them on as many widgets as needed.
+//	In lua a clip is made from an array of keyframes, with timestamps relative to when the clip is played.
+
+extern lua_State* main_lua_state;
+
+// Read the timeless keyframe members of the table at idx, missing members are copied from the fallback.
+void lua_tokeyframe_fallback(struct lua_State* L, int idx, struct keyframe* const keyframe, const struct keyframe* const fallback)
+{
+	idx = lua_absindex(L, idx);
+
+#define READ_FALLBACK(member,...) keyframe-> ## member = (LUA_TNUMBER == lua_getfield(L, idx, #member)) ? \
+	luaL_checknumber(L, -1) : fallback-> ## member; lua_pop(L, 1);
+
+	FOR_KEYFRAME_MEMBERS_TIMELESS(READ_FALLBACK)
+}
+
+// Read the optional interpolation of the table at idx and apply it to the segment ending at the last pushed keyframe.
+//	Hermite controls are tangents (change per second) and bezier controls are inner control keyframes.
+void lua_tointerpolation(struct lua_State* L, int idx, struct render_interface* const render_interface)
+{
+	static const char* const names[] = { "linear", "ease_in", "ease_out", "ease_in_out",
+		"ease_in_cubic", "ease_out_cubic", "hermite", "bezier", NULL };
+
+	struct render_interface_internal* const internal = (struct render_interface_internal* const)render_interface;
+
+	idx = lua_absindex(L, idx);
+
+	if (LUA_TSTRING != lua_getfield(L, idx, "interpolation"))
+	{
+		lua_pop(L, 1);
+		return;
+	}
+
+	const enum TWEENER_INTERPOLATION interpolation = luaL_checkoption(L, -1, NULL, names);
+	lua_pop(L, 1);
+
+	if (interpolation == TWEENER_INTERPOLATION_LINEAR)
+	{
+		tweener_point_interpolation(internal->keyframe_tweener, interpolation, NULL, NULL);
+		return;
+	}
+
+	if (internal->keyframe_tweener->used < 2)
+		return;
+
+	// Missing tangent members are flat, missing control members sit on their keyframe
+	const double* const end = tweener_destination(internal->keyframe_tweener);
+	const double* const start = end - KEYFRAME_MEMBER_CNT - 1;
+
+	struct keyframe start_fallback, end_fallback, start_control, end_control;
+	double* start_ptr = NULL;
+	double* end_ptr = NULL;
+
+	memset(&start_fallback, 0, sizeof(struct keyframe));
+	memset(&end_fallback, 0, sizeof(struct keyframe));
+
+	if (interpolation == TWEENER_INTERPOLATION_BEZIER)
+	{
+		memcpy(keyframe_channels(&start_fallback), start + 1, KEYFRAME_MEMBER_CNT * sizeof(double));
+		memcpy(keyframe_channels(&end_fallback), end + 1, KEYFRAME_MEMBER_CNT * sizeof(double));
+	}
+
+	if (LUA_TTABLE == lua_getfield(L, idx, "start_control"))
+	{
+		lua_tokeyframe_fallback(L, -1, &start_control, &start_fallback);
+		start_ptr = keyframe_channels(&start_control);
+	}
+
+	if (LUA_TTABLE == lua_getfield(L, idx, "end_control"))
+	{
+		lua_tokeyframe_fallback(L, -1, &end_control, &end_fallback);
+		end_ptr = keyframe_channels(&end_control);
+	}
+
+	lua_pop(L, 2);
+
+	tweener_point_interpolation(internal->keyframe_tweener, interpolation, start_ptr, end_ptr);
+}
+
+// Check the value at idx is a clip
+struct tweener_clip* lua_toanimationclip(struct lua_State* L, int idx)
+{
+	struct tweener_clip** const handle = (struct tweener_clip**)luaL_checkudata(L, idx, "animation_clip_mt");
+
+	return handle ? *handle : NULL;
+}
+
+static int animation_clip_new(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	const size_t keyframe_cnt = lua_rawlen(L, 1);
+
+	struct tweener_clip** const handle = lua_newuserdatauv(L, sizeof(struct tweener_clip*), 0);
+	*handle = tweener_clip_new(KEYFRAME_MEMBER_CNT, keyframe_cnt);
+
+	if (!*handle)
+		return 0;
+
+	luaL_getmetatable(L, "animation_clip_mt");
+	lua_setmetatable(L, -2);
+
+	// Clip keypoints default to the identity keyframe
+	struct keyframe identity;
+	keyframe_default(&identity);
+
+	for (size_t i = 1; i <= keyframe_cnt; i++)
+	{
+		lua_geti(L, 1, i);
+
+		if (!lua_istable(L, -1))
+		{
+			lua_pop(L, 1);
+			continue;
+		}
+
+		double* const point = tweener_clip_new_point(*handle);
+
+		if (!point)
+			return luaL_error(L, "Unable to allocate animation clip keypoint.");
+
+		lua_getfield(L, -1, "timestamp");
+		point[0] = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : 0;
+		lua_pop(L, 1);
+
+		struct keyframe keyframe;
+		lua_tokeyframe_fallback(L, -1, &keyframe, &identity);
+		memcpy(point + 1, keyframe_channels(&keyframe), KEYFRAME_MEMBER_CNT * sizeof(double));
+
+		lua_pop(L, 1);
+	}
+
+	return 1;
+}
+
+static int animation_clip_gc(lua_State* L)
+{
+	struct tweener_clip** const handle = (struct tweener_clip**)luaL_checkudata(L, 1, "animation_clip_mt");
+
+	if (*handle)
+		tweener_clip_release(*handle);
+
+	*handle = NULL;
+
+	return 0;
+}
+
+static void animation_clip_init()
+{
+	lua_pushcfunction(main_lua_state, animation_clip_new);
+	lua_setglobal(main_lua_state, "animation_clip");
+
+	luaL_newmetatable(main_lua_state, "animation_clip_mt");
+
+	const struct luaL_Reg meta_methods[] = {
+		{"__gc",animation_clip_gc},
+		{NULL,NULL}
+	};
+
+	luaL_setfuncs(main_lua_state, meta_methods, 0);
+
+	lua_pop(main_lua_state, 1);
+}
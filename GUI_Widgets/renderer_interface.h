@@ -4,6 +4,10 @@
 #pragma once
 #include <allegro5/allegro_color.h>
 
+struct lua_State;
+struct tweener_clip;
+struct render_interface;
+
 // Simple transparent keyframe object meant to represent the all the data needed to make a transform at a given time.
 #define FOR_KEYFRAME_MEMBERS_TIMELESS(DO)\
     DO(x, 1) \
@@ -34,6 +38,10 @@ void keyframe_build_transform(const struct keyframe* const, ALLEGRO_TRANSFORM* c
 
 void lua_pushkeyframe(struct lua_State*, const struct keyframe* const);
 void lua_tokeyframe(struct lua_State*, struct keyframe* const);
+void lua_tokeyframe_fallback(struct lua_State*, int, struct keyframe* const, const struct keyframe* const);
+void lua_tointerpolation(struct lua_State*, int, struct render_interface* const);
+
+struct tweener_clip* lua_toanimationclip(struct lua_State*, int);
 
 // An obficated struct for managing all the style information in one place.
 //	It's maing job is to manage a queue of keyframes to output the current keyframe on each frame.
@@ -42,16 +50,34 @@ struct render_interface
 {
 	struct keyframe current;
 	double half_width, half_height;
+
+	// If set current is relative to the parent's transform, see render_interface_set_parent
+	const struct render_interface* parent;
 };
 
 // Render Methods
 struct render_interface* render_interface_new(size_t);
+void render_interface_reserve(size_t);
+void render_interface_release(struct render_interface* const);
+
+void render_interface_set_parent(struct render_interface* const, const struct render_interface* const);
+void render_interface_refresh_transforms();
+const ALLEGRO_TRANSFORM* render_interface_world_transform(const struct render_interface* const);
+const ALLEGRO_TRANSFORM* render_interface_world_inverse(const struct render_interface* const);
+const ALLEGRO_TRANSFORM* render_interface_world_cached(const struct render_interface* const, ALLEGRO_TRANSFORM* const);
+bool render_interface_off_screen(const struct render_interface* const);
+void render_interface_lod_unseen(struct render_interface* const);
 
 void render_interface_set(struct render_interface* const, struct keyframe* const);
 void render_interface_interupt(struct render_interface* const);
 void render_interface_push_keyframe(struct render_interface* const, struct keyframe*);
 void render_interface_copy_destination(struct render_interface* const, struct keyframe*);
 void render_interface_enter_loop(struct render_interface* const, double);
+void render_interface_play_clip(struct render_interface* const, struct tweener_clip*, double, struct keyframe*, struct keyframe*);
+void render_interface_gpu_keyframes(struct render_interface* const, bool);
+size_t render_interface_gpu_moving();
+bool render_interface_gpu_destination(const struct render_interface* const, struct keyframe* const);
+void render_interface_sync(struct render_interface* const);
 void render_interface_callback(struct sytle_element* const, void (*)(void*), void*);
 
 // Effect 
@@ -10,6 +10,7 @@
 #include <allegro5/allegro_color.h>
 
 #include "resource_manager.h"
+#include "render_state.h"
 
 #include "lua/lua.h"
 #include "lua/lualib.h"
@@ -58,6 +59,126 @@ static ALLEGRO_FONT* font_table[FONT_ID_COUNT];
 static ALLEGRO_BITMAP* icon_table[ICON_ID_COUNT] = {NULL};
 static ALLEGRO_BITMAP* tile_table[TILE_CNT] = {NULL};
 
+// Tiles and icons are packed into atlas pages as they are loaded, the tables hold sub-bitmaps of the pages.
+//	Sprites on the same page are drawn in one call while bitmap drawing is held.
+//	Pages are filled shelf by shelf, a shelf is a row as tall as the tallest sprite in it.
+#define ATLAS_PAGE_SIZE 4096
+#define ATLAS_PADDING 1 // Transparent border so filtering doesn't bleed neighbours in
+
+struct atlas_page
+{
+	ALLEGRO_BITMAP* bitmap;
+	int shelf_x, shelf_y, shelf_height;
+};
+
+static struct atlas_page* atlas_pages;
+static size_t atlas_used, atlas_allocated;
+static int atlas_page_size;
+
+// Start a new page, must be called with the atlas state stored
+static struct atlas_page* atlas_new_page()
+{
+	if (atlas_allocated <= atlas_used)
+	{
+		const size_t new_cnt = atlas_allocated ? 2 * atlas_allocated : 4;
+
+		struct atlas_page* memsafe_hande = realloc(atlas_pages, new_cnt * sizeof(struct atlas_page));
+
+		if (!memsafe_hande)
+			return NULL;
+
+		atlas_pages = memsafe_hande;
+		atlas_allocated = new_cnt;
+	}
+
+	ALLEGRO_BITMAP* const bitmap = al_create_bitmap(atlas_page_size, atlas_page_size);
+
+	if (!bitmap)
+		return NULL;
+
+	al_set_target_bitmap(bitmap);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+	atlas_pages[atlas_used] = (struct atlas_page){ .bitmap = bitmap };
+
+	return atlas_pages + atlas_used++;
+}
+
+// Copy the bitmap into the atlas and return its sub-bitmap, the bitmap itself if it doesn't fit.
+static ALLEGRO_BITMAP* atlas_pack(ALLEGRO_BITMAP* const bitmap)
+{
+	if (!bitmap)
+		return NULL;
+
+	if (!atlas_page_size)
+	{
+		const int max_size = al_get_display_option(al_get_current_display(), ALLEGRO_MAX_BITMAP_SIZE);
+		atlas_page_size = max_size > 0 && max_size < ATLAS_PAGE_SIZE ? max_size : ATLAS_PAGE_SIZE;
+	}
+
+	const int width = al_get_bitmap_width(bitmap) + 2 * ATLAS_PADDING;
+	const int height = al_get_bitmap_height(bitmap) + 2 * ATLAS_PADDING;
+
+	if (width > atlas_page_size || height > atlas_page_size)
+		return bitmap;
+
+	// Packing can happen mid draw, so held drawing is flushed and the draw state put back after
+	const bool held = al_is_bitmap_drawing_held();
+
+	if (held)
+		al_hold_bitmap_drawing(false);
+
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+
+	struct atlas_page* page = atlas_used ? atlas_pages + atlas_used - 1 : NULL;
+
+	if (page && page->shelf_x + width > atlas_page_size)
+	{
+		page->shelf_y += page->shelf_height;
+		page->shelf_x = 0;
+		page->shelf_height = 0;
+	}
+
+	if (!page || page->shelf_y + height > atlas_page_size)
+		page = atlas_new_page();
+
+	ALLEGRO_BITMAP* sprite = NULL;
+
+	if (page)
+	{
+		const int x = page->shelf_x + ATLAS_PADDING;
+		const int y = page->shelf_y + ATLAS_PADDING;
+
+		al_set_target_bitmap(page->bitmap);
+		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+		al_draw_bitmap(bitmap, x, y, 0);
+
+		sprite = al_create_sub_bitmap(page->bitmap, x, y, width - 2 * ATLAS_PADDING, height - 2 * ATLAS_PADDING);
+
+		if (sprite)
+		{
+			page->shelf_x += width;
+
+			if (page->shelf_height < height)
+				page->shelf_height = height;
+		}
+	}
+
+	al_restore_state(&state);
+	render_state_invalidate();
+
+	if (held)
+		al_hold_bitmap_drawing(true);
+
+	if (!sprite)
+		return bitmap;
+
+	al_destroy_bitmap(bitmap);
+
+	return sprite;
+}
+
 // Turns the bitmap and lua file uploaded by Emily Huo to itch.io into a ALLEGRO_FONT
 // Currently ignores kerling and xoffset
 static ALLEGRO_FONT* emily_huo_font(lua_State* lua, const char* font_name)
@@ -244,7 +365,7 @@ ALLEGRO_BITMAP* resource_manager_icon(enum icon_id id)
 		char file_name_buffer[256];
 		sprintf_s(file_name_buffer, 256, "res/icons/%d.png", id);
 
-		icon_table[id] = al_load_bitmap(file_name_buffer);
+		icon_table[id] = atlas_pack(al_load_bitmap(file_name_buffer));
 	}
 
 	return icon_table[id];
@@ -257,7 +378,7 @@ ALLEGRO_BITMAP* resource_manager_tile(enum tile_id id)
 		char file_name_buffer[256];
 		sprintf_s(file_name_buffer, 256, "res/tiles/%d.png", id);
 
-		tile_table[id] = al_load_bitmap(file_name_buffer);
+		tile_table[id] = atlas_pack(al_load_bitmap(file_name_buffer));
 	}
 
 	return tile_table[id];
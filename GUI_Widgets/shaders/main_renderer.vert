@@ -21,8 +21,49 @@ varying vec3 local_position;
 uniform vec2 display_dimensions;
 uniform vec2 object_scale;
 
+// GPU evaluated keyframes, the current segment of the keyframe path is blended here instead of on the CPU.
+// (Keyframes are ordered x, y, sx, sy, theta, camera, dx, dy, the timestamps stay on the CPU)
+uniform bool gpu_keyframe;
+uniform float keyframe_segment[16]; // The start keyframe then the end keyframe
+uniform float keyframe_blend; // How far through the segment, from 0 to 1
+uniform float camera_keyframe[5];
+
+// Only read while the widget engine is depth sorting, see widget_engine_draw
+uniform float depth;
+
 //uniform float saturate;
 
+// Mirrors al_build_transform
+vec2 build_transform(vec2 position, float x, float y, float sx, float sy, float theta)
+{
+	float c = cos(theta);
+	float s = sin(theta);
+
+	return vec2(sx * (c * position.x - s * position.y) + x,
+		sy * (s * position.x + c * position.y) + y);
+}
+
+// Mirrors keyframe_build_transform for the blended segment
+vec4 keyframe_transform(vec4 position)
+{
+	float k[8];
+
+	for (int i = 0; i < 8; i++)
+		k[i] = mix(keyframe_segment[i], keyframe_segment[8 + i], keyframe_blend);
+
+	vec2 world = build_transform(position.xy, k[0], k[1], k[2], k[3], k[4]);
+
+	if (k[5] >= 0.0)
+		world = build_transform(world,
+			camera_keyframe[0] * k[5],
+			camera_keyframe[1] * k[5],
+			camera_keyframe[2] * k[5] + (1.0 - k[5]),
+			camera_keyframe[3] * k[5] + (1.0 - k[5]),
+			camera_keyframe[4] * k[5]);
+
+	return vec4(world + vec2(k[6], k[7]), position.zw);
+}
+
 void main()
 {
 	varying_color = al_color;
@@ -38,5 +79,10 @@ void main()
 
 	//varying_color.xyz = max(varying_color.xyz,saturate);
 	
-	gl_Position = al_projview_matrix * al_pos;
+	if (gpu_keyframe)
+		gl_Position = al_projview_matrix * keyframe_transform(al_pos);
+	else
+		gl_Position = al_projview_matrix * al_pos;
+
+	gl_Position.z = depth * gl_Position.w;
 }
@@ -0,0 +1,36 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+//
+// The instanced variant of main_renderer.vert used by the sprite batch.
+// Every instance is one textured quad, its world transform and depth travel with it instead of as uniforms.
+
+// The corner of the unit quad, (0,0) to (1,1)
+attribute vec2 corner;
+
+// Per instance, see struct sprite_instance
+attribute vec4 instance_axes;	// The linear part of the world transform, columns
+attribute vec3 instance_origin;	// The translation of the world transform and the depth
+attribute vec4 instance_bounds;	// Local x0, y0, x1, y1
+attribute vec4 instance_uv;		// Atlas u0, v0, u1, v1
+attribute vec4 instance_tint;
+
+uniform mat4 al_projview_matrix;
+
+varying vec4 varying_color;
+varying vec2 varying_texcoord;
+
+varying vec3 local_position;
+
+void main()
+{
+	vec2 local = mix(instance_bounds.xy, instance_bounds.zw, corner);
+	vec2 world = instance_axes.xy * local.x + instance_axes.zw * local.y + instance_origin.xy;
+
+	varying_color = instance_tint;
+	varying_texcoord = mix(instance_uv.xy, instance_uv.zw, corner);
+	local_position = vec3(local, 0.0);
+
+	gl_Position = al_projview_matrix * vec4(world, 0.0, 1.0);
+	gl_Position.z = instance_origin.z * gl_Position.w;
+}
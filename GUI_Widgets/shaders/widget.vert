@@ -8,7 +8,8 @@ attribute vec4 al_pos;
 attribute vec4 al_color;
 attribute vec2 al_texcoord;
 
-uniform vec3 picker_color;
+// The widget ID, written out as little endian bytes so it survives the 8 bit color channels exactly.
+uniform int picker_id;
 
 uniform mat4 al_projview_matrix;
 uniform bool al_use_tex_matrix;
@@ -22,7 +23,10 @@ uniform float saturate;
 
 void main()
 {
-	varying_color = vec4(picker_color,1);
+	float id = float(picker_id);
+	vec3 id_bytes = vec3(mod(id, 256.0), mod(floor(id / 256.0), 256.0), floor(id / 65536.0));
+
+	varying_color = vec4(id_bytes / 255.0, 1);
 
 	if (al_use_tex_matrix) {
 		vec4 uv = al_tex_matrix * vec4(al_texcoord, 0, 1);
@@ -81,10 +81,13 @@ WG_DECL(update)
 	if (slider->state != UPDATE)
 		 return;
 
+	// Stay awake until the slider is let go
+	widget_interface_wake(widget_interface);
+
 	WG_DIMENSIONS
 	double x = mouse_x;
 	double y = mouse_y;
-	widget_screen_to_local(slider->widget_interface, &x, &y);
+	widget_screen_to_local_cached(slider->widget_interface, &x, &y);
 
 	slider->progress = x / (2*(half_width - slider_padding))+  0.5;
 
@@ -98,6 +101,8 @@ WG_DECL(left_click)
 {
 	WG_CAST
 	slider->state = UPDATE;
+
+	widget_interface_wake(widget_interface);
 }
 
 WG_DECL(left_click_end)
@@ -124,9 +129,12 @@ WG_DECL(hover_end)
 
 WG_JMP_TBL
 {
+	.pool = WG_POOL,
+
 	.draw = draw,
 	.mask = mask,
 	.update = update,
+	.update_on_demand = true,
 
 	.left_click = left_click,
 	.left_click_end = left_click_end,
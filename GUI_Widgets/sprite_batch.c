@@ -0,0 +1,241 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+#include "sprite_batch.h"
+#include "renderer_interface.h"
+#include "render_state.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <allegro5/allegro_opengl.h>
+
+// Mirrors the instance attributes of main_renderer_instanced.vert
+struct sprite_instance
+{
+	float axes[4];
+	float origin[3];
+	float bounds[4];
+	float uv[4];
+	float tint[4];
+};
+
+static ALLEGRO_SHADER* shader;
+static GLuint vertex_array;
+static GLuint corner_buffer;
+static GLuint instance_buffer;
+
+static struct sprite_instance* instances;
+static size_t used, allocated;
+static ALLEGRO_BITMAP* texture; // The atlas page of the sprites in the batch
+static float depth;
+static int alpha_function = ALLEGRO_RENDER_NOT_EQUAL; // Matches the display, see main
+static int alpha_value;
+
+// Point an instance attribute at its member of struct sprite_instance
+static bool instance_attribute(GLuint program, const char* name, GLint size, size_t offset)
+{
+	const GLint location = glGetAttribLocation(program, name);
+
+	if (location < 0)
+		return false;
+
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(struct sprite_instance), (const void*)offset);
+	glVertexAttribDivisor(location, 1);
+
+	return true;
+}
+
+// Only the vertex shader differs from the main renderer, so the materials behave the same.
+//	If anything fails the batch stays unavailable and widgets are drawn normally.
+void sprite_batch_init()
+{
+	shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+
+	if (!shader)
+		return;
+
+	if (!al_attach_shader_source_file(shader, ALLEGRO_VERTEX_SHADER, "shaders/main_renderer_instanced.vert") ||
+		!al_attach_shader_source_file(shader, ALLEGRO_PIXEL_SHADER, "shaders/main_renderer.frag") ||
+		!al_build_shader(shader))
+	{
+		fprintf(stderr, "Failed to build instanced renderer shader.\n%s\n", al_get_shader_log(shader));
+		al_destroy_shader(shader);
+		shader = NULL;
+		return;
+	}
+
+	const GLuint program = al_get_opengl_program_object(shader);
+
+	const float corners[12] = { 0,0, 1,0, 1,1, 0,0, 1,1, 0,1 };
+
+	GLint previous_vertex_array;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+
+	glGenBuffers(1, &corner_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, corner_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+	const GLint corner = glGetAttribLocation(program, "corner");
+	bool complete = corner >= 0;
+
+	if (complete)
+	{
+		glEnableVertexAttribArray(corner);
+		glVertexAttribPointer(corner, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+
+	complete = complete &&
+		instance_attribute(program, "instance_axes", 4, offsetof(struct sprite_instance, axes)) &&
+		instance_attribute(program, "instance_origin", 3, offsetof(struct sprite_instance, origin)) &&
+		instance_attribute(program, "instance_bounds", 4, offsetof(struct sprite_instance, bounds)) &&
+		instance_attribute(program, "instance_uv", 4, offsetof(struct sprite_instance, uv)) &&
+		instance_attribute(program, "instance_tint", 4, offsetof(struct sprite_instance, tint));
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(previous_vertex_array);
+
+	if (!complete)
+	{
+		fprintf(stderr, "Instanced renderer shader is missing attributes.\n");
+		al_destroy_shader(shader);
+		shader = NULL;
+		return;
+	}
+
+	// Sprites are plain textured quads, the alpha test is set on each flush, see sprite_batch_alpha_test
+	ALLEGRO_SHADER* const previous = al_get_current_shader();
+
+	al_use_shader(shader);
+	al_set_shader_bool("al_use_tex", true);
+	al_set_shader_bool("al_alpha_test", true);
+	al_set_shader_int("effect_id", 0);
+	al_set_shader_int("selection_id", 0);
+	al_use_shader(previous);
+
+	render_state_invalidate();
+}
+
+bool sprite_batch_available()
+{
+	return shader != NULL;
+}
+
+// The depth of the sprites pushed after, see widget_engine_draw
+void sprite_batch_depth(float new_depth)
+{
+	depth = new_depth;
+}
+
+// The batch draws outside of allegro, so it keeps its own alpha test. Same arguments as render_state_alpha_test.
+void sprite_batch_alpha_test(int function, int value)
+{
+	if (function == alpha_function && value == alpha_value)
+		return;
+
+	sprite_batch_flush();
+
+	alpha_function = function;
+	alpha_value = value;
+}
+
+// Queue the sprite stretched over the local bounds x0, y0, x1, y1 of the render_interface.
+void sprite_batch_push(const struct render_interface* const render_interface, ALLEGRO_BITMAP* sprite, ALLEGRO_COLOR tint,
+	float x0, float y0, float x1, float y1)
+{
+	ALLEGRO_BITMAP* const parent = al_get_parent_bitmap(sprite);
+	ALLEGRO_BITMAP* const page = parent ? parent : sprite;
+
+	if (page != texture)
+	{
+		sprite_batch_flush();
+		texture = page;
+	}
+
+	if (allocated <= used)
+	{
+		const size_t new_cnt = allocated ? 2 * allocated : 256;
+
+		struct sprite_instance* memsafe_hande = realloc(instances, new_cnt * sizeof(struct sprite_instance));
+
+		// Out of room, draw what there is and start over
+		if (!memsafe_hande)
+		{
+			sprite_batch_flush();
+			texture = page;
+
+			if (!allocated)
+				return;
+		}
+		else
+		{
+			instances = memsafe_hande;
+			allocated = new_cnt;
+		}
+	}
+
+	// Allegro keeps textures upside down and possibly padded
+	int texture_width, texture_height;
+	al_get_opengl_texture_size(page, &texture_width, &texture_height);
+
+	const float x = parent ? al_get_sub_bitmap_x(sprite) : 0;
+	const float y = parent ? al_get_sub_bitmap_y(sprite) : 0;
+	const float page_height = al_get_bitmap_height(page);
+
+	const ALLEGRO_TRANSFORM* const transform = render_interface_world_transform(render_interface);
+
+	instances[used++] = (struct sprite_instance)
+	{
+		.axes = { transform->m[0][0], transform->m[0][1], transform->m[1][0], transform->m[1][1] },
+		.origin = { transform->m[3][0], transform->m[3][1], depth },
+		.bounds = { x0, y0, x1, y1 },
+		.uv = {
+			x / texture_width,
+			(page_height - y) / texture_height,
+			(x + al_get_bitmap_width(sprite)) / texture_width,
+			(page_height - y - al_get_bitmap_height(sprite)) / texture_height },
+		.tint = { tint.r, tint.g, tint.b, tint.a },
+	};
+}
+
+// Draw the batch in one instanced call, leaves the previous shader in use.
+void sprite_batch_flush()
+{
+	if (!used)
+		return;
+
+	ALLEGRO_SHADER* const previous = al_get_current_shader();
+
+	// The world transform is per instance
+	ALLEGRO_TRANSFORM identity;
+	al_identity_transform(&identity);
+
+	render_state_use_shader(shader);
+	render_state_transform(&identity);
+	al_set_shader_sampler("al_tex", texture, 0);
+	al_set_shader_int("al_alpha_func", alpha_function);
+	al_set_shader_float("al_alpha_test_val", alpha_value / 255.0f);
+
+	GLint previous_vertex_array;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, used * sizeof(struct sprite_instance), instances, GL_STREAM_DRAW);
+
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)used);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(previous_vertex_array);
+
+	render_state_use_shader(previous);
+
+	used = 0;
+}
@@ -0,0 +1,22 @@
+// Copyright 2023 Kieran W Harvie. All rights reserved.
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+#pragma once
+
+#include <allegro5/allegro.h>
+#include <stdbool.h>
+
+struct render_interface;
+
+// Instanced drawing of textured quads, for widget types drawn entirely from atlas sprites (like tiles).
+//	Sprites are collected with their render_interface's world transform and the whole batch is one instanced call.
+//	The batch is flushed when the texture changes, so sprites sharing an atlas page draw together.
+//	Anything drawn normally has to flush the batch first to keep the draw order.
+
+void sprite_batch_init();
+bool sprite_batch_available();
+
+void sprite_batch_depth(float);
+void sprite_batch_alpha_test(int, int);
+void sprite_batch_push(const struct render_interface* const, ALLEGRO_BITMAP*, ALLEGRO_COLOR, float, float, float, float);
+void sprite_batch_flush();
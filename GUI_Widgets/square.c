@@ -31,16 +31,26 @@ static void mask(const struct zone* const square)
 	al_draw_filled_rectangle(-50, -50, 50, 50, al_map_rgb_f(1, 1, 1));
 }
 
+// Untextured so every opaque square batches together
+static size_t batch_key(const struct zone* const square)
+{
+	return ((struct square*)square->upcast)->color.a < 1 ? 0 : 1;
+}
+
+static struct widget_pool square_pool;
+
 static struct zone_jump_table square_table =
 {
+	.pool = &square_pool,
 	.draw = draw,
 	.mask = mask,
+	.batch_key = batch_key,
 	.gc = gc,
 };
 
 struct zone* square_new(lua_State* L)
 {
-	 struct square* const square = malloc(sizeof(struct square));
+	 struct square* const square = widget_pool_alloc(&square_pool, sizeof(struct square));
 
 	if (!square)
 		return 0;
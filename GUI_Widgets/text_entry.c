@@ -5,6 +5,7 @@
 #include "widget_interface.h"
 #include "resource_manager.h"
 #include "widget_style_sheet.h"
+#include "render_state.h"
 
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_opengl.h>
@@ -39,7 +40,7 @@ WG_DECL_DRAW
 	const double text_left_padding = 10;
 
 	// Clear the stencil buffer channels
-	glEnable(GL_STENCIL_TEST);
+	render_state_stencil_test(true);
 	glStencilMask(0x03);
 
 	// Set Stencil Function to set stencil channels to 1 
@@ -75,7 +76,7 @@ WG_DECL_DRAW
 				0, text_entry->input);
 	}
 
-	glDisable(GL_STENCIL_TEST);
+	render_state_stencil_test(false);
 
 	al_draw_rounded_rectangle(-half_width, -half_height,
 		half_width, half_height, 
@@ -212,9 +213,12 @@ WG_DECL(event_handler)
 
 WG_JMP_TBL
 {
+	.pool = WG_POOL,
+
 	.draw = draw,
 	.mask = mask,
 	.event_handler = event_handler,
+	.event_mask = WIDGET_EVENT_MASK(KEYBOARD),
 
 	.left_click = left_click,
 	.hover_start = hover_start,
@@ -5,6 +5,8 @@
 #include "board_manager.h"
 #include "resource_manager.h"
 #include "meeple_tile_utility.h"
+#include "hash.h"
+#include "sprite_batch.h"
 
 extern lua_State* main_lua_state;
 
@@ -33,7 +35,8 @@ const char* tile_to_string[] = {
 	"skull",
 	"swamp",
 	"tower",
-	"town"
+	"town",
+	NULL
 };
 
 struct tile
@@ -47,7 +50,7 @@ static void gc(struct zone* const zone)
 
 }
 
-static inline enum TILE_PALLET state_to_pallet(struct zone* zone)
+static inline enum TILE_PALLET state_to_pallet(const struct zone* const zone)
 {
 	if (zone->nominated)
 		return TILE_PALLET_NOMINATED;
@@ -58,32 +61,93 @@ static inline enum TILE_PALLET state_to_pallet(struct zone* zone)
 	return TILE_PALLET_IDLE;
 }
 
+static ALLEGRO_COLOR tile_tint(const struct zone* const zone)
+{
+	static ALLEGRO_COLOR tile_pallet[TEAM_CNT][TILE_PALLET_CNT];
+	static bool tile_pallet_ready;
+
+	// The color names are looked up once
+	if (!tile_pallet_ready)
+	{
+		const char* const names[TEAM_CNT][TILE_PALLET_CNT] =
+		{
+			{"White","Khaki","Gold"},
+			{"tomato","crimson","brown"},
+			{"lightblue","royalblue","steelblue"},
+		};
+
+		for (size_t i = 0; i < TEAM_CNT; i++)
+			for (size_t j = 0; j < TILE_PALLET_CNT; j++)
+				tile_pallet[i][j] = al_color_name(names[i][j]);
+
+		tile_pallet_ready = true;
+	}
+
+	return tile_pallet[((const struct tile*)zone->upcast)->team][state_to_pallet(zone)];
+}
+
 static void draw(const struct zone* const zone)
 {
 	const double half_width = zone->widget_interface->render_interface->half_width;
 	const double half_height = zone->widget_interface->render_interface->half_height;
 	struct tile* const tile = (struct tile* const) zone->upcast;
 
-	al_draw_scaled_bitmap(resource_manager_tile(TILE_EMPTY),
+	// Resolved before holding since loading packs the atlas
+	ALLEGRO_BITMAP* const empty = resource_manager_tile(TILE_EMPTY);
+	ALLEGRO_BITMAP* const art = resource_manager_tile(tile->id);
+
+	// Both come off the same atlas page so held they are drawn in one call
+	al_hold_bitmap_drawing(true);
+
+	al_draw_scaled_bitmap(empty,
 		0, 0, 300, 300,
 		-half_width, -half_height, 2 * half_width, 2 * half_height,
 		0);
 
 	if (tile->id == TILE_EMPTY)
-		return;
-
-	ALLEGRO_COLOR tile_pallet[TEAM_CNT][TILE_PALLET_CNT] =
 	{
-		{al_color_name("White"),al_color_name("Khaki"),al_color_name("Gold")},
-		{al_color_name("tomato"),al_color_name("crimson"),al_color_name("brown")},
-		{al_color_name("lightblue"),al_color_name("royalblue"),al_color_name("steelblue")},
-	};
+		al_hold_bitmap_drawing(false);
+		return;
+	}
 
-	al_draw_tinted_scaled_bitmap(resource_manager_tile(tile->id),
-		tile_pallet[tile->team][state_to_pallet(zone)],
+	al_draw_tinted_scaled_bitmap(art,
+		tile_tint(zone),
 		0, 0, 300, 300, 
 		-half_width, -half_height, 2*half_width, 2*half_height, 
 		0);
+
+	al_hold_bitmap_drawing(false);
+}
+
+// The same two sprites as draw, but through the sprite batch
+static bool instance(const struct zone* const zone)
+{
+	const struct render_interface* const render_interface = zone->widget_interface->render_interface;
+	const float half_width = render_interface->half_width;
+	const float half_height = render_interface->half_height;
+	const struct tile* const tile = (const struct tile*)zone->upcast;
+
+	ALLEGRO_BITMAP* const empty = resource_manager_tile(TILE_EMPTY);
+	ALLEGRO_BITMAP* const art = resource_manager_tile(tile->id);
+
+	if (!empty || !art)
+		return false;
+
+	sprite_batch_push(render_interface, empty, al_map_rgb(255, 255, 255), -half_width, -half_height, half_width, half_height);
+
+	if (tile->id != TILE_EMPTY)
+		sprite_batch_push(render_interface, art, tile_tint(zone), -half_width, -half_height, half_width, half_height);
+
+	return true;
+}
+
+// Tiles are batched by the atlas page of their art
+static size_t batch_key(const struct zone* const zone)
+{
+	ALLEGRO_BITMAP* const art = resource_manager_tile(((const struct tile*)zone->upcast)->id);
+	ALLEGRO_BITMAP* const page = art ? al_get_parent_bitmap(art) : NULL;
+
+	return (size_t)(page ? page : art);
 }
 
 static void mask(const struct zone* const zone)
@@ -121,16 +185,17 @@ static void lua_toid(lua_State* L, int idx, struct tile* tile)
 {
 
 
+	static struct hash_table* tile_id_table = NULL;
+
+	if (!tile_id_table && !(tile_id_table = hash_table_new(tile_to_string)))
+		luaL_error(L, "Failed to build the tile id hash.");
+
 	if (lua_type(L, -1) == LUA_TSTRING)
 	{
-		const char* tile_id = luaL_tolstring(L, idx, NULL);
+		const uint8_t i = hash_table_get(tile_id_table, luaL_tolstring(L, idx, NULL));
 
-		for (size_t i = 0; i<TILE_CNT; i++)
-			if (strcmp(tile_id, tile_to_string[i]) == 0)
-			{
-				tile->id = i;
-				break;
-			}
+		if (i != HASH_TABLE_MISS)
+			tile->id = i;
 
 		lua_pop(L, 1);
 	}
@@ -186,10 +251,15 @@ int newindex(struct zone* const zone)
 	}
 }
 
+static struct widget_pool tile_pool;
+
 static struct zone_jump_table tile_table =
 {
+	.pool = &tile_pool,
 	.draw = draw,
 	.mask = mask,
+	.batch_key = batch_key,
+	.instance = instance,
 	.gc = gc,
 	.index = index,
 	.newindex = newindex
@@ -197,7 +267,7 @@ static struct zone_jump_table tile_table =
 
 struct zone* tile_new(lua_State* L)
 {
-	struct tile* tile = malloc(sizeof(struct tile));
+	struct tile* tile = widget_pool_alloc(&tile_pool, sizeof(struct tile));
 
 	if (!tile)
 		return NULL;
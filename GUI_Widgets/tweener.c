@@ -11,13 +11,48 @@
 #include "tweener.h"
 
 #include <limits.h>
+#include <float.h>
 
 extern double current_timestamp;
 
-static struct tweener* tweeners_list;
-static size_t tweeners_allocated;
+// Tweeners are handed out as pointers, so they're kept in fixed size chunks that never move as the pool grows
+#define TWEENER_CHUNK 256
+
+static struct tweener** tweener_chunks;
+static size_t tweener_chunks_used, tweener_chunks_allocated;
 static size_t tweeners_used;
 
+static inline struct tweener* tweener_at(size_t idx)
+{
+	return tweener_chunks[idx / TWEENER_CHUNK] + idx % TWEENER_CHUNK;
+}
+
+// Add a chunk to the pool
+static bool tweener_pool_grow()
+{
+	if (tweener_chunks_allocated <= tweener_chunks_used)
+	{
+		const size_t new_cnt = tweener_chunks_allocated ? 2 * tweener_chunks_allocated : 16;
+
+		struct tweener** memsafe_hande = realloc(tweener_chunks, new_cnt * sizeof(struct tweener*));
+
+		if (!memsafe_hande)
+			return false;
+
+		tweener_chunks = memsafe_hande;
+		tweener_chunks_allocated = new_cnt;
+	}
+
+	struct tweener* const chunk = malloc(TWEENER_CHUNK * sizeof(struct tweener));
+
+	if (!chunk)
+		return false;
+
+	tweener_chunks[tweener_chunks_used++] = chunk;
+
+	return true;
+}
+
 #ifdef _TWEENER_DEBUG
 #include <stdio.h>
 static void _check_nan(double* ptr, size_t cnt)
@@ -63,29 +98,18 @@ static void _print_keyframes(struct tweener* tweener)
 void tweener_init()
 {
 	tweeners_used = 0;
-	tweeners_allocated = 100;
-	tweeners_list = malloc(tweeners_allocated * sizeof(struct tweener));
+	tweener_pool_grow();
 }
 
 struct tweener* tweener_new(size_t channels, size_t hint)
 {
-	if (tweeners_allocated <= tweeners_used)
-	{
-		const size_t new_cnt = 2 * tweeners_allocated;
-
-		struct tweener* memsafe_hande = realloc(tweeners_list, new_cnt * sizeof(struct tweener));
-
-		if (!memsafe_hande)
-			return NULL;
-
-		tweeners_list = memsafe_hande;
-		tweeners_allocated = new_cnt;
-	}
+	if (tweener_chunks_used * TWEENER_CHUNK <= tweeners_used && !tweener_pool_grow())
+		return NULL;
 
 	if (hint == 0)
 		hint = 1;
 
-	struct tweener* tweener = tweeners_list + tweeners_used++;
+	struct tweener* tweener = tweener_at(tweeners_used++);
 
 	tweener->used = 0;
 	tweener->allocated = hint;
@@ -96,19 +120,86 @@ struct tweener* tweener_new(size_t channels, size_t hint)
 	tweener->funct = NULL;
 	tweener->data = NULL;
 	tweener->looping_idx = 0;
+	tweener->is_owned = false;
+	tweener->clip = NULL;
+	tweener->clip_transform = NULL;
+	tweener->clip_playing = false;
+	tweener->interpolation = NULL;
+	tweener->coefficients = NULL;
 
 	return (struct tweener*)tweener;
 }
 
+// Make room for cnt more tweeners so bulk construction allocates up front, the tweeners handed out don't move.
+void tweener_pool_reserve(size_t cnt)
+{
+	while (tweener_chunks_used * TWEENER_CHUNK < tweeners_used + cnt)
+		if (!tweener_pool_grow())
+			return;
+}
+
+// Let go of the tweener's clip, if it has one.
+//	Only called from the main thread so the clip's reference count doesn't need a lock.
+static inline void tweener_drop_clip(struct tweener* const tweener)
+{
+	if (tweener->clip)
+		tweener_clip_release(tweener->clip);
+
+	tweener->clip = NULL;
+	tweener->clip_playing = false;
+}
+
 void tweener_del(struct tweener* tweener)
 {
+	tweener_drop_clip(tweener);
+
 	free(tweener->keypoints);
 	free(tweener->current);
+	free(tweener->clip_transform);
+	free(tweener->interpolation);
+	free(tweener->coefficients);
 
 	//TODO: pop the tweener from tweener_list and free the struct
 }
 
-static inline void tweener_blend_nonlooping(struct tweener* tweener)
+// Reset the tweener to how tweener_new left it, keeping its buffers so reusing it doesn't allocate.
+void tweener_recycle(struct tweener* const tweener)
+{
+	tweener_drop_clip(tweener);
+
+	tweener->used = 0;
+	tweener->looping_time = -1;
+	tweener->looping_idx = 0;
+	tweener->funct = NULL;
+	tweener->data = NULL;
+}
+
+// Number of coefficients stored for each segment, a cubic for every channel
+#define SEGMENT_STRIDE(tweener) (4 * (tweener)->channels)
+
+// Blend the segment between two keypoints, blend is the normalized time through the segment.
+//	Non-linear segments evaluate the cubic precomputed by tweener_point_interpolation.
+static inline void tweener_blend_segment(const struct tweener* const tweener,
+	size_t start_idx, size_t end_idx, double blend, double* const output)
+{
+	const double* const start = tweener->keypoints + start_idx * (tweener->channels + 1) + 1;
+	const double* const end = tweener->keypoints + end_idx * (tweener->channels + 1) + 1;
+
+	if (!tweener->interpolation || tweener->interpolation[end_idx] == TWEENER_INTERPOLATION_LINEAR)
+	{
+		for (size_t i = 0; i < tweener->channels; i++)
+			output[i] = blend * end[i] + (1 - blend) * start[i];
+
+		return;
+	}
+
+	const double* c = tweener->coefficients + end_idx * SEGMENT_STRIDE(tweener);
+
+	for (size_t i = 0; i < tweener->channels; i++, c += 4)
+		output[i] = c[0] + blend * (c[1] + blend * (c[2] + blend * c[3]));
+}
+
+static inline void tweener_blend_nonlooping(struct tweener* tweener, double* const output)
 {
 	// Clean old frames;
 	size_t first_future_frame = 0;
@@ -130,15 +221,23 @@ static inline void tweener_blend_nonlooping(struct tweener* tweener)
 			for (size_t j = 0; j <= tweener->channels; j++)
 				tweener->keypoints[(i - step) * (tweener->channels + 1) + j] = tweener->keypoints[i * (tweener->channels + 1) + j];
 
+		if (tweener->interpolation)
+		{
+			memmove(tweener->interpolation, tweener->interpolation + step,
+				(tweener->used - step) * sizeof(enum TWEENER_INTERPOLATION));
+			memmove(tweener->coefficients, tweener->coefficients + step * SEGMENT_STRIDE(tweener),
+				(tweener->used - step) * SEGMENT_STRIDE(tweener) * sizeof(double));
+		}
+
 		tweener->used -= step;
 
 		PRINT_KEYFRAMES(tweener)
 
 		if (tweener->used == 1)
 		{
-			memcpy(tweener->current, tweener->keypoints + 1, tweener->channels * sizeof(double));
+			memcpy(output, tweener->keypoints + 1, tweener->channels * sizeof(double));
 
-			CHECK_TWEENER_NAN(tweener);
+			CHECK_KEYPOINT_NAN(output, tweener->channels);
 
 			if (tweener->funct)
 				tweener->funct(tweener->data);
@@ -152,13 +251,12 @@ static inline void tweener_blend_nonlooping(struct tweener* tweener)
 	const double denominator = (tweener->keypoints[tweener->channels + 1] - tweener->keypoints[0]);
 	const double blend = (current_timestamp - tweener->keypoints[0]) / denominator;
 
-	for (size_t i = 0; i < tweener->channels; i++)
-		tweener->current[i] = blend * tweener->keypoints[i + 2 + tweener->channels] + (1 - blend) * tweener->keypoints[i + 1];
+	tweener_blend_segment(tweener, 0, 1, blend, output);
 
-	CHECK_TWEENER_NAN(tweener);
+	CHECK_KEYPOINT_NAN(output, tweener->channels);
 }
 
-static inline void tweener_blend_looping(struct tweener* tweener)
+static inline void tweener_blend_looping(struct tweener* tweener, double* const output)
 {
 	while (tweener->keypoints[tweener->looping_idx * (tweener->channels + 1)] <= current_timestamp)
 	{
@@ -171,83 +269,295 @@ static inline void tweener_blend_looping(struct tweener* tweener)
 			(tweener->looping_idx + 1) % tweener->used : 0;
 	}
 
-	const size_t end_idx = tweener->looping_idx * (tweener->channels + 1);
-	const size_t start_idx = (tweener->channels + 1) * ((tweener->looping_idx >= 1) ? 
-		(tweener->looping_idx - 1) : tweener->used - 1);
+	const size_t end_idx = tweener->looping_idx;
+	const size_t start_idx = (tweener->looping_idx >= 1) ? 
+		(tweener->looping_idx - 1) : tweener->used - 1;
 	
-	const double blend = (current_timestamp - tweener->keypoints[start_idx]) / 
-		(tweener->keypoints[end_idx] - tweener->keypoints[start_idx]);
+	const double blend = (current_timestamp - tweener->keypoints[start_idx * (tweener->channels + 1)]) /
+		(tweener->keypoints[end_idx * (tweener->channels + 1)] - tweener->keypoints[start_idx * (tweener->channels + 1)]);
+
+	tweener_blend_segment(tweener, start_idx, end_idx, blend, output);
+
+	CHECK_KEYPOINT_NAN(output, tweener->channels);
+}
+
+static inline void tweener_blend_clip(struct tweener* tweener, double* const output)
+{
+	const struct tweener_clip* const clip = tweener->clip;
+	const size_t stride = clip->channels + 1;
+	const double local_timestamp = current_timestamp - tweener->clip_start;
+
+	// The destination keypoint already has the offset and scale applied, see tweener_play_clip.
+	if (local_timestamp >= clip->keypoints[(clip->used - 1) * stride])
+	{
+		memcpy(output, tweener->keypoints + 1, tweener->channels * sizeof(double));
+
+		tweener->clip_playing = false;
+
+		if (tweener->funct)
+			tweener->funct(tweener->data);
+
+		return;
+	}
+
+	while (tweener->clip_idx + 2 < clip->used && 
+		clip->keypoints[(tweener->clip_idx + 1) * stride] <= local_timestamp)
+		tweener->clip_idx++;
+
+	const double* const start = clip->keypoints + tweener->clip_idx * stride;
+	const double* const end = start + stride;
+	const double* const offset = tweener->clip_transform;
+	const double* const scale = tweener->clip_transform + tweener->channels;
+
+	// Hold the first keypoint if the clip hasn't started yet
+	double blend = (local_timestamp - start[0]) / (end[0] - start[0]);
+
+	if (blend < 0)
+		blend = 0;
 
 	for (size_t i = 0; i < tweener->channels; i++)
-		tweener->current[i] = blend * tweener->keypoints[i + end_idx + 1] + 
-			(1 - blend) * tweener->keypoints[i + start_idx + 1];
+		output[i] = offset[i] + scale[i] * (blend * end[i + 1] + (1 - blend) * start[i + 1]);
 
-	CHECK_TWEENER_NAN(tweener);
+	CHECK_KEYPOINT_NAN(output, tweener->channels);
 }
 
-static inline void tweener_blend_keypoints(struct tweener* const tweener)
+// Blend the keypoints for the current timestamp and write the channels to output.
+//	Output can be the tweener's own current or memory owned by the caller.
+void tweener_blend(struct tweener* const tweener, double* const output)
 {
-	if (tweener->used > 1)
+	if (tweener->clip_playing)
+		tweener_blend_clip(tweener, output);
+	else if (tweener->used > 1)
 		if (tweener->looping_time > 0)
-			tweener_blend_looping(tweener);
+			tweener_blend_looping(tweener, output);
 		else
-			tweener_blend_nonlooping(tweener);
+			tweener_blend_nonlooping(tweener, output);
+}
 
-	CHECK_TWEENER_NAN(tweener);
+static void tweener_update_work(struct tweener* tweener)
+{
+	tweener_blend(tweener, tweener->current);
 }
 
 struct work_queue* tweener_update()
 {
 	struct work_queue* work_queue = work_queue_create();
 
-	for (struct tweener* p = tweeners_list;
-		p != (tweeners_used ? tweeners_list + tweeners_used : tweeners_list);
-		p++)
-		if (p->used > 1)
-			if(p->looping_time > 0)
-				work_queue_push(work_queue, tweener_blend_looping, p);
-			else
-				work_queue_push(work_queue, tweener_blend_nonlooping, p);
+	// Owned tweeners are blended by their owner's update, see tweener_set_owned.
+	for (size_t i = 0; i < tweeners_used; i++)
+	{
+		struct tweener* const p = tweener_at(i);
+
+		if (!p->is_owned && tweener_is_active(p))
+			work_queue_push(work_queue, tweener_update_work, p);
+	}
 
 	return work_queue;
 }
 
+// Whether the tweener has a path to blend
+bool tweener_is_active(const struct tweener* const tweener)
+{
+	return tweener->used > 1 || tweener->clip_playing;
+}
+
+// When the current path finishes and the callback fires, looping paths never finish.
+double tweener_end_timestamp(const struct tweener* const tweener)
+{
+	if (tweener->clip_playing)
+		return tweener->clip_start + tweener->clip->keypoints[(tweener->clip->used - 1) * (tweener->clip->channels + 1)];
+
+	if (tweener->looping_time > 0)
+		return DBL_MAX;
+
+	return tweener->keypoints[(tweener->used - 1) * (tweener->channels + 1)];
+}
+
+// The linear segment being blended (timestamp then channels) so it can be evaluated elsewhere, like in a shader.
+//	False if the tweener isn't on a plain linear segment.
+bool tweener_linear_segment(const struct tweener* const tweener, const double** start, const double** end)
+{
+	if (tweener->used < 2 || tweener->clip_playing || tweener->looping_time > 0)
+		return false;
+
+	if (tweener->interpolation && tweener->interpolation[1] != TWEENER_INTERPOLATION_LINEAR)
+		return false;
+
+	*start = tweener->keypoints;
+	*end = tweener->keypoints + tweener->channels + 1;
+
+	return true;
+}
+
 void tweener_set(struct tweener* const tweener, double* keypoint)
 {
+	tweener_drop_clip(tweener);
+
 	tweener->used = 1;
 
+	if (tweener->interpolation)
+		tweener->interpolation[0] = TWEENER_INTERPOLATION_LINEAR;
+
 	memcpy(tweener->current, keypoint, tweener->channels * sizeof(double));
 	memcpy(tweener->keypoints + 1, keypoint, tweener->channels * sizeof(double));
 
 	CHECK_TWEENER_NAN(tweener);
 }
 
-double* tweener_new_point(struct tweener* tweener)
+// Grow the keypoint (and segment) storage
+static bool tweener_reserve(struct tweener* const tweener, size_t new_cnt)
 {
-	if (tweener->allocated <= tweener->used)
+	double* memsafe_hande = realloc(tweener->keypoints, new_cnt * (tweener->channels + 1) * sizeof(double));
+
+	if (!memsafe_hande)
+		return false;
+
+	tweener->keypoints = memsafe_hande;
+
+	if (tweener->interpolation)
 	{
-		const size_t new_cnt = 2 * tweener->allocated;
+		enum TWEENER_INTERPOLATION* interpolation_handle = realloc(tweener->interpolation, new_cnt * sizeof(enum TWEENER_INTERPOLATION));
 
-		double* memsafe_hande = realloc(tweener->keypoints, new_cnt * (tweener->channels + 1) * sizeof(double));
+		if (!interpolation_handle)
+			return false;
 
-		if (!memsafe_hande)
-			return NULL;
+		tweener->interpolation = interpolation_handle;
+
+		double* coefficients_handle = realloc(tweener->coefficients, new_cnt * SEGMENT_STRIDE(tweener) * sizeof(double));
 
-		tweener->keypoints = memsafe_hande;
-		tweener->allocated = new_cnt;
+		if (!coefficients_handle)
+			return false;
+
+		tweener->coefficients = coefficients_handle;
 	}
 
+	tweener->allocated = new_cnt;
+
+	return true;
+}
+
+double* tweener_new_point(struct tweener* tweener)
+{
+	// A clip can't be extended, so keypoints start from where the clip is now.
+	if (tweener->clip_playing)
+		tweener_interupt(tweener);
+
+	if (tweener->allocated <= tweener->used)
+		if (!tweener_reserve(tweener, 2 * tweener->allocated))
+			return NULL;
+
 	if (tweener->used == 1)
 		tweener->keypoints[0] = current_timestamp;
 
 	double* output = tweener->keypoints + tweener->used * (tweener->channels + 1);
 
 	memcpy(output, output - tweener->channels - 1, sizeof(double) * (tweener->channels + 1));
+
+	if (tweener->interpolation)
+		tweener->interpolation[tweener->used] = TWEENER_INTERPOLATION_LINEAR;
+
 	tweener->used++;
 
 	return output;
 }
 
+// Set how the segment ending at the last pushed keypoint is interpolated, call after the keypoint is written.
+//	The segment is baked into a cubic per channel here so blending it is a fixed cost.
+//	For hermite the controls are the start and end tangents (per second), 
+//	for bezier they are the two inner control points, a NULL control defaults to a zero tangent or the nearest keypoint.
+void tweener_point_interpolation(struct tweener* const tweener, enum TWEENER_INTERPOLATION interpolation,
+	const double* start_control, const double* end_control)
+{
+	if (tweener->used < 2)
+		return;
+
+	if (!tweener->interpolation)
+	{
+		if (interpolation == TWEENER_INTERPOLATION_LINEAR)
+			return;
+
+		tweener->interpolation = malloc(tweener->allocated * sizeof(enum TWEENER_INTERPOLATION));
+		tweener->coefficients = malloc(tweener->allocated * SEGMENT_STRIDE(tweener) * sizeof(double));
+
+		if (!tweener->interpolation || !tweener->coefficients)
+		{
+			free(tweener->interpolation);
+			free(tweener->coefficients);
+
+			tweener->interpolation = NULL;
+			tweener->coefficients = NULL;
+
+			return;
+		}
+
+		for (size_t i = 0; i < tweener->allocated; i++)
+			tweener->interpolation[i] = TWEENER_INTERPOLATION_LINEAR;
+	}
+
+	const size_t idx = tweener->used - 1;
+	const double* const start = tweener->keypoints + (idx - 1) * (tweener->channels + 1);
+	const double* const end = start + tweener->channels + 1;
+	const double duration = end[0] - start[0];
+
+	double* c = tweener->coefficients + idx * SEGMENT_STRIDE(tweener);
+
+	tweener->interpolation[idx] = interpolation;
+
+	for (size_t i = 0; i < tweener->channels; i++, c += 4)
+	{
+		const double p0 = start[i + 1];
+		const double p1 = end[i + 1];
+		const double delta = p1 - p0;
+
+		// Tangents in normalized time
+		double m0 = 0, m1 = 0;
+
+		switch (interpolation)
+		{
+		default:
+		case TWEENER_INTERPOLATION_LINEAR:
+			c[0] = p0, c[1] = delta, c[2] = 0, c[3] = 0;
+			continue;
+
+		case TWEENER_INTERPOLATION_EASE_IN:
+			c[0] = p0, c[1] = 0, c[2] = delta, c[3] = 0;
+			continue;
+
+		case TWEENER_INTERPOLATION_EASE_OUT:
+			c[0] = p0, c[1] = 2 * delta, c[2] = -delta, c[3] = 0;
+			continue;
+
+		case TWEENER_INTERPOLATION_EASE_IN_OUT:
+			c[0] = p0, c[1] = 0, c[2] = 3 * delta, c[3] = -2 * delta;
+			continue;
+
+		case TWEENER_INTERPOLATION_EASE_IN_CUBIC:
+			c[0] = p0, c[1] = 0, c[2] = 0, c[3] = delta;
+			continue;
+
+		case TWEENER_INTERPOLATION_EASE_OUT_CUBIC:
+			c[0] = p0, c[1] = 3 * delta, c[2] = -3 * delta, c[3] = delta;
+			continue;
+
+		case TWEENER_INTERPOLATION_HERMITE:
+			m0 = start_control ? start_control[i] * duration : 0;
+			m1 = end_control ? end_control[i] * duration : 0;
+			break;
+
+		case TWEENER_INTERPOLATION_BEZIER:
+			m0 = start_control ? 3 * (start_control[i] - p0) : 0;
+			m1 = end_control ? 3 * (p1 - end_control[i]) : 0;
+			break;
+		}
+
+		// Hermite basis expanded into powers of the blend
+		c[0] = p0;
+		c[1] = m0;
+		c[2] = 3 * delta - 2 * m0 - m1;
+		c[3] = -2 * delta + m0 + m1;
+	}
+}
+
 void tweener_enter_loop(struct tweener* tweener, double loop_offset)
 {
 	if (tweener->used < 2)
@@ -268,12 +578,19 @@ void tweener_enter_loop(struct tweener* tweener, double loop_offset)
 
 	tweener->looping_idx = idx;
 	tweener->looping_time = loop_time;
+
+	// The wrap around segment was never pushed so it's blended linearly
+	if (tweener->interpolation)
+		tweener->interpolation[0] = TWEENER_INTERPOLATION_LINEAR;
 }
 
 void tweener_interupt(struct tweener* const tweener)
 {
-	if (tweener->used > 1)
-		tweener_blend_keypoints(tweener);
+	// An owned tweener's current isn't blended each frame, at rest the first keypoint is up to date.
+	if (tweener_is_active(tweener))
+		tweener_blend(tweener, tweener->current);
+	else if (tweener->used == 1)
+		memcpy(tweener->current, tweener->keypoints + 1, tweener->channels * sizeof(double));
 
 	tweener->looping_time = -1;
 
@@ -285,6 +602,11 @@ double* tweener_destination(struct tweener* const tweener)
 	return tweener->keypoints + (tweener->used - 1) * (tweener->channels + 1);
 }
 
+void tweener_set_owned(struct tweener* const tweener, bool is_owned)
+{
+	tweener->is_owned = is_owned;
+}
+
 void tweener_set_callback(struct tweener* const tweener, void (*funct)(void*), void* data)
 {
 	tweener->funct = funct;
@@ -305,3 +627,119 @@ void tweener_plot(struct tweener* const tweener,
 		funct(timestamp, new_point, udata);
 	}
 }
+
+// Create a clip with a single reference, owned by the caller.
+struct tweener_clip* tweener_clip_new(size_t channels, size_t hint)
+{
+	struct tweener_clip* const clip = malloc(sizeof(struct tweener_clip));
+
+	if (!clip)
+		return NULL;
+
+	if (hint == 0)
+		hint = 1;
+
+	*clip = (struct tweener_clip)
+	{
+		.channels = channels,
+		.used = 0,
+		.allocated = hint,
+		.keypoints = malloc(hint * (channels + 1) * sizeof(double)),
+		.references = 1,
+	};
+
+	if (!clip->keypoints)
+	{
+		free(clip);
+		return NULL;
+	}
+
+	return clip;
+}
+
+// Append a keypoint to the clip, the new keypoint is a copy of the last.
+double* tweener_clip_new_point(struct tweener_clip* clip)
+{
+	if (clip->allocated <= clip->used)
+	{
+		const size_t new_cnt = 2 * clip->allocated;
+
+		double* memsafe_hande = realloc(clip->keypoints, new_cnt * (clip->channels + 1) * sizeof(double));
+
+		if (!memsafe_hande)
+			return NULL;
+
+		clip->keypoints = memsafe_hande;
+		clip->allocated = new_cnt;
+	}
+
+	double* output = clip->keypoints + clip->used * (clip->channels + 1);
+
+	if (clip->used)
+		memcpy(output, output - clip->channels - 1, sizeof(double) * (clip->channels + 1));
+	else
+		memset(output, 0, sizeof(double) * (clip->channels + 1));
+
+	clip->used++;
+
+	return output;
+}
+
+void tweener_clip_retain(struct tweener_clip* clip)
+{
+	clip->references++;
+}
+
+void tweener_clip_release(struct tweener_clip* clip)
+{
+	if (--clip->references)
+		return;
+
+	free(clip->keypoints);
+	free(clip);
+}
+
+// Play a clip from the start timestamp, replacing the current path.
+//	Each channel is played as offset + scale * clip, a NULL offset or scale is treated as 0 or 1.
+void tweener_play_clip(struct tweener* const tweener, struct tweener_clip* clip,
+	double start, const double* offset, const double* scale)
+{
+	if (!clip || clip->used == 0 || clip->channels != tweener->channels)
+		return;
+
+	if (!tweener->clip_transform)
+	{
+		tweener->clip_transform = malloc(2 * tweener->channels * sizeof(double));
+
+		if (!tweener->clip_transform)
+			return;
+	}
+
+	for (size_t i = 0; i < tweener->channels; i++)
+	{
+		tweener->clip_transform[i] = offset ? offset[i] : 0;
+		tweener->clip_transform[tweener->channels + i] = scale ? scale[i] : 1;
+	}
+
+	// Take the reference before dropping the old clip in case they're the same clip
+	tweener_clip_retain(clip);
+	tweener_drop_clip(tweener);
+
+	// Store the transformed last keypoint as the destination so tweener_destination stays correct.
+	const double* const last = clip->keypoints + (clip->used - 1) * (clip->channels + 1);
+
+	tweener->used = 1;
+	tweener->looping_time = -1;
+	tweener->keypoints[0] = start + last[0];
+
+	for (size_t i = 0; i < tweener->channels; i++)
+		tweener->keypoints[i + 1] = tweener->clip_transform[i] + tweener->clip_transform[tweener->channels + i] * last[i + 1];
+
+	tweener->clip = clip;
+	tweener->clip_start = start;
+	tweener->clip_idx = 0;
+	tweener->clip_playing = clip->used > 1;
+
+	if (!tweener->clip_playing)
+		memcpy(tweener->current, tweener->keypoints + 1, tweener->channels * sizeof(double));
+}
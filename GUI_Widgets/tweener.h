@@ -9,9 +9,40 @@
 //	The structs memory is quite raw so it is only avavlible to widget writers.
 //	The user should be using the render_interface.
 // 
-//	TODO: Include more complex tweening options like keypoint weight and tangent.
+//	Segments are linear unless set otherwise with tweener_point_interpolation.
 #pragma once
 
+#include <stdbool.h>
+
+// How a segment between two keypoints is interpolated.
+enum TWEENER_INTERPOLATION
+{
+	TWEENER_INTERPOLATION_LINEAR,
+	TWEENER_INTERPOLATION_EASE_IN,
+	TWEENER_INTERPOLATION_EASE_OUT,
+	TWEENER_INTERPOLATION_EASE_IN_OUT,
+	TWEENER_INTERPOLATION_EASE_IN_CUBIC,
+	TWEENER_INTERPOLATION_EASE_OUT_CUBIC,
+	TWEENER_INTERPOLATION_HERMITE,
+	TWEENER_INTERPOLATION_BEZIER,
+
+	TWEENER_INTERPOLATION_CNT
+};
+
+// An immutable, reference counted path of keypoints that many tweeners can play at once.
+//	Timestamps are relative to when the clip is played.
+//	Each tweener playing the clip maps it's channels through its own offset and scale so the keypoints are never copied.
+//	Only push keypoints before the clip is first played.
+struct tweener_clip
+{
+	size_t channels; //	The zeroth channel is the timestamp
+
+	size_t used, allocated;
+	double* keypoints;
+
+	size_t references;
+};
+
 struct tweener
 {
 	size_t channels; //	The zeroth channel is the timestamp
@@ -20,6 +51,11 @@ struct tweener
 	size_t used, allocated;
 	double* keypoints; // could optimize better with flexable array member?
 
+	// The interpolation and cubic coefficients of the segment ending at each keypoint.
+	// (Both NULL until a non-linear segment is pushed.)
+	enum TWEENER_INTERPOLATION* interpolation;
+	double* coefficients;
+
 	// Looping data
 	size_t looping_idx;
 	double looping_time;
@@ -27,19 +63,49 @@ struct tweener
 	// Callback when the path ends 
 	void (*funct)(void*);
 	void* data;
+
+	// Owned tweeners are skipped by tweener_update, the owner calls tweener_blend itself.
+	//	Lets the owner write the blend straight to where it's used, current is only kept up to date by tweener_interupt.
+	bool is_owned;
+
+	// Clip playback data
+	// (clip_transform is the channel offsets followed by the channel scales.)
+	struct tweener_clip* clip;
+	double* clip_transform;
+	double clip_start;
+	size_t clip_idx;
+	bool clip_playing;
 };
 
 struct tweener* tweener_new(size_t channels, size_t hint);
+void tweener_pool_reserve(size_t cnt);
 void tweener_del(struct tweener* tweener);
+void tweener_recycle(struct tweener* const tweener);
 
 void tweener_set(struct tweener* const tweener, double* keypoint);
 double* tweener_new_point(struct tweener* tweener);
+void tweener_point_interpolation(struct tweener* const tweener, enum TWEENER_INTERPOLATION interpolation,
+	const double* start_control, const double* end_control);
 void tweener_enter_loop(struct tweener* tweener, double loop_offset);
 void tweener_interupt(struct tweener* const tweener);
 double* tweener_destination(struct tweener* const tweener);
 
 void tweener_set_callback(struct tweener* const tweener, void (*funct)(void*), void* data);
 
+void tweener_set_owned(struct tweener* const tweener, bool is_owned);
+void tweener_blend(struct tweener* const tweener, double* const output);
+bool tweener_is_active(const struct tweener* const tweener);
+double tweener_end_timestamp(const struct tweener* const tweener);
+bool tweener_linear_segment(const struct tweener* const tweener, const double** start, const double** end);
+
+struct tweener_clip* tweener_clip_new(size_t channels, size_t hint);
+double* tweener_clip_new_point(struct tweener_clip* clip);
+void tweener_clip_retain(struct tweener_clip* clip);
+void tweener_clip_release(struct tweener_clip* clip);
+
+void tweener_play_clip(struct tweener* const tweener, struct tweener_clip* clip,
+	double start, const double* offset, const double* scale);
+
 // Not tested
 void tweener_plot(struct tweener* const tweener,
 	void (*funct)(double timestamp, double* output, void* udata), void* udata,
@@ -5,6 +5,10 @@
 #include "widget_interface.h"
 #include "thread_pool.h"
 #include "camera.h"
+#include "hash.h"
+#include "render_state.h"
+#include "sprite_batch.h"
+#include "render_cache.h"
 
 #include <allegro5/allegro_font.h>
 #include <allegro5/allegro_opengl.h>
@@ -30,6 +34,8 @@ void material_apply(const struct material* const);
 extern void render_interface_global_predraw();
 extern void render_interface_use_transform(const struct render_interface* const);
 extern void render_interface_predraw(const struct render_interface* const);
+extern bool render_interface_batched_predraw(const struct render_interface* const);
+extern size_t render_interface_revision();
 
 // Global Variables
 extern double mouse_x;
@@ -39,7 +45,6 @@ extern double delta_timestamp;
 extern const ALLEGRO_FONT* debug_font;
 extern ALLEGRO_EVENT current_event;
 extern const ALLEGRO_TRANSFORM identity_transform;
-extern void invert_transform_3D(ALLEGRO_TRANSFORM*);
 extern lua_State* const main_lua_state;
 
 /*********************************************/
@@ -66,6 +71,15 @@ enum WIDGET_UPVALUE
     WIDGET_UPVALUE_START = 0,
 };
 
+enum WIDGET_CALLBACK
+{
+#define CALLBACK_ENUM(method,argcnt,offset) WIDGET_CALLBACK_ ## method = offset,
+    FOR_CALLBACKS(CALLBACK_ENUM)
+};
+
+// Registry slot of the weak widgets table, so finding a widget's udata skips the global lookup
+static int widgets_ref = LUA_REFNIL;
+
 struct widget
 {
 	struct widget_interface;
@@ -73,30 +87,71 @@ struct widget
 
     struct widget* next;
     struct widget* previous;
-
-    // TODO: Manage Registry Use
-    // This method creates a new registry entry for every function call.
-    // I don't want to prematurly optimize it away but if it becomes to much it can be replace by a single table.
-    // And if that become's too much a single registry entryf or each widget. 
-    // And if that's too much a sperate table for all active widgets.
-    // (This could also have other uses + it should be a weak table to not interfer with gc).
-    // Q: Why not use uservalues. A: The callback can be called from anycontext, i.e. not knowing the udata.
-    // 
-    // Maype some look up
+    size_t z_index; // Index into z_order, stable until the queue changes
+
+    // The lua callbacks live in a table in the widget's last uservalue, indexed by WIDGET_CALLBACK + 1.
+    // The udata is found through the weak widgets table (cached in the registry) so callbacks can be called from any context.
+    // A strong registry reference to the udata would stop the widget from ever being collected.
+    // Each set callback has its bit set here so unset callbacks never touch lua.
+    unsigned int lua_callbacks;
+
+    // Hierarchy, a child's transform is composed with its parent's, see render_interface_set_parent.
+    // Culling is memoized per cull_stamp, see widget_culled.
+    struct widget* parent;
+    size_t children;
+    size_t cull_stamp;
+    bool hidden;
+    bool culled;
+
+    // Update scheduling, see widget_interface_wake
+    bool awake;
+    bool keep_awake;
+
+    // Retained drawing, see widget_interface_invalidate
+    struct render_cache* cache;
+
+    // Picking spatial index state, see pick_index_refit
     struct
     {
-#define DECLARE(method,...) int method;
-        FOR_CALLBACKS(DECLARE)
-    } lua;
+        struct keyframe keyframe;
+        ALLEGRO_TRANSFORM parent_transform;
+        double half_width, half_height;
+        float min_x, min_y, max_x, max_y;
+        int cell_x0, cell_y0, cell_x1, cell_y1;
+        size_t generation;
+        size_t id;
+        bool indexed;
+    } pick;
 };
 
-// TODO: implement as a hash so we don't have to use macros
-// but hashing is still runtime maybe enumerations would be better
-#define call_lua(widget,method) if(widget->lua. ## method != LUA_REFNIL) do{ \
-    lua_rawgeti(main_lua_state, LUA_REGISTRYINDEX, widget->lua. ## method); \
-	lua_getglobal(main_lua_state, "widgets"); \
-	lua_rawgetp(main_lua_state, -1, widget); \
-	lua_remove(main_lua_state, -2); \
+// Push the widget's udata
+static inline void push_widget_udata(const struct widget* const widget)
+{
+    lua_rawgeti(main_lua_state, LUA_REGISTRYINDEX, widgets_ref);
+    lua_rawgetp(main_lua_state, -1, widget);
+    lua_remove(main_lua_state, -2);
+}
+
+// Push the widget's callback table, creating it if needed. The udata must be at idx.
+static inline void push_callback_table(const struct widget* const widget, int idx)
+{
+    idx = lua_absindex(main_lua_state, idx);
+
+    if (LUA_TTABLE == lua_getiuservalue(main_lua_state, idx, (int)widget->jump_table->uservalues + 1))
+        return;
+
+    lua_pop(main_lua_state, 1);
+    lua_createtable(main_lua_state, WIDGET_CALLBACK_drop_end + 1, 0);
+    lua_pushvalue(main_lua_state, -1);
+    lua_setiuservalue(main_lua_state, idx, (int)widget->jump_table->uservalues + 1);
+}
+
+#define call_lua(widget,method) if(widget->lua_callbacks & (1u << WIDGET_CALLBACK_ ## method)) do{ \
+    push_widget_udata(widget); \
+    lua_getiuservalue(main_lua_state, -1, (int)widget->jump_table->uservalues + 1); \
+    lua_rawgeti(main_lua_state, -1, WIDGET_CALLBACK_ ## method + 1); \
+    lua_replace(main_lua_state, -2); \
+    lua_insert(main_lua_state, -2); \
     if(lua_pcall(main_lua_state, 1, 0, 0) != LUA_OK) \
     {\
         printf("Error calling method \"" #method "\" on widget \"" #widget"\".\n\tFrom " __FILE__ " at line %d.\n\n\t%s\n\n", \
@@ -163,6 +218,108 @@ static const char* engine_state_str[] = {
 static struct widget* queue_head;
 static struct widget* queue_tail;
 static struct widget* lock;
+static size_t pick_epoch; // Advances with z-order changes, see pick
+
+// The hot widget data in queue order, so the per-frame sweeps are linear scans instead of pointer chasing.
+//  The linked list stays the source of truth for ordering, this is rebuilt from it when the queue changes.
+struct widget_hot
+{
+    struct widget* widget;
+    const struct widget_jump_table* jump_table;
+    struct render_interface* render_interface;
+};
+
+static struct widget_hot* z_order;
+static size_t z_order_used, z_order_allocated;
+static size_t z_order_lock; // Sweeps start here, the widgets before the lock are locked out
+static bool z_order_dirty;
+
+// The widgets with an event_handler, one list per event class so an event only touches its subscribers.
+//  Unsubscribed slots are cleared and compacted before the next dispatch, the lists are kept in z-order.
+struct event_subscribers
+{
+    struct widget** widgets;
+    size_t used, allocated;
+    bool dirty;
+    bool unsorted; // Moved widgets are out of place, the rest keep their order
+};
+
+static struct event_subscribers event_subscribers[WIDGET_EVENT_CNT];
+
+// Depth sorted drawing, see widget_engine_draw
+#define DEPTH_SORT_ALPHA_CUTOFF 127 // Texels more opaque than this write depth, out of 255
+
+struct depth_draw
+{
+    struct widget* widget;
+    size_t key;
+    float depth;
+};
+
+static bool depth_sort;
+static struct depth_draw* depth_draws;
+static size_t depth_draws_allocated;
+
+static size_t cull_stamp; // Advances each frame and whenever a widget is hidden or reparented
+
+// The widgets with an update that get it this frame, the rest are never visited.
+//  Collected widgets leave their slot cleared until the next sweep compacts it.
+static struct widget** awake;
+static size_t awake_used, awake_allocated;
+static bool event_subscribers_unsorted;
+
+// Rebuild z_order if the queue changed since the last sweep.
+//  If it can't grow the old z_order is kept and stays dirty, popped widgets are already cleared from it.
+static void z_order_refresh()
+{
+    if (!z_order_dirty)
+        return;
+
+    size_t queue_cnt = 0;
+
+    for (struct widget* widget = queue_head; widget; widget = widget->next)
+        queue_cnt++;
+
+    if (z_order_allocated < queue_cnt)
+    {
+        size_t new_cnt = z_order_allocated ? z_order_allocated : 64;
+
+        while (new_cnt < queue_cnt)
+            new_cnt *= 2;
+
+        struct widget_hot* memsafe_hande = realloc(z_order, new_cnt * sizeof(struct widget_hot));
+
+        if (!memsafe_hande)
+            return;
+
+        z_order = memsafe_hande;
+        z_order_allocated = new_cnt;
+    }
+
+    z_order_used = 0;
+    z_order_lock = SIZE_MAX;
+
+    for (struct widget* widget = queue_head; widget; widget = widget->next)
+    {
+        if (widget == lock)
+            z_order_lock = z_order_used;
+
+        widget->z_index = z_order_used;
+
+        z_order[z_order_used++] = (struct widget_hot)
+        {
+            .widget = widget,
+            .jump_table = widget->jump_table,
+            .render_interface = widget->render_interface,
+        };
+    }
+
+    if (z_order_lock == SIZE_MAX)
+        z_order_lock = z_order_used;
+
+    event_subscribers_unsorted = true;
+    z_order_dirty = false;
+}
 
 // Pop a widget out of the engine
 static void queue_pop(struct widget_interface* const ptr)
@@ -181,6 +338,12 @@ static void queue_pop(struct widget_interface* const ptr)
 
     if (ptr == (struct widget_interface* const) lock)
         lock = widget->next;
+
+    // Sweeps on a stale z_order skip the empty slot
+    if (widget->z_index < z_order_used && z_order[widget->z_index].widget == widget)
+        z_order[widget->z_index].widget = NULL;
+
+    z_order_dirty = true;
 }
 
 // Insert the first widget behind the second
@@ -192,6 +355,8 @@ static void queue_insert(struct widget_interface* mover, struct widget_interface
     struct widget* internal_target = (struct widget*)target;
     struct widget* internal_mover = (struct widget*)mover;
 
+    z_order_dirty = true;
+
     internal_mover->next = internal_target;
 
     // If the second is null append the first to the head
@@ -200,11 +365,12 @@ static void queue_insert(struct widget_interface* mover, struct widget_interface
         if (internal_target == queue_head)
             lock = internal_target;
 
+        internal_mover->previous = internal_target->previous;
+
         if (internal_target->previous)
             internal_target->previous->next = internal_mover;
         else
-            queue_tail = internal_mover;
-
+            queue_head = internal_mover;
 
         internal_target->previous = internal_mover;
     }
@@ -221,16 +387,81 @@ static void queue_insert(struct widget_interface* mover, struct widget_interface
     }
 }
 
+static inline unsigned int widget_event_mask(const struct widget* const widget)
+{
+    if (!widget->jump_table->event_handler)
+        return 0;
+
+    return widget->jump_table->event_mask ? widget->jump_table->event_mask : WIDGET_EVENT_ALL;
+}
+
+// True if the widget holds its own slot in a fresh z_order
+static inline bool z_order_holds(const struct widget* const widget)
+{
+    return !z_order_dirty && widget->z_index < z_order_used && z_order[widget->z_index].widget == widget;
+}
+
+// Shift the slots between the mover's old and new index, the rest of z_order is untouched
+static void z_order_move(struct widget* const mover, size_t to)
+{
+    const size_t from = mover->z_index;
+    const size_t first = from < to ? from : to;
+    const size_t last = from < to ? to : from;
+
+    if (from < to)
+        memmove(z_order + from, z_order + from + 1, (to - from) * sizeof(struct widget_hot));
+    else
+        memmove(z_order + to + 1, z_order + to, (from - to) * sizeof(struct widget_hot));
+
+    z_order[to] = (struct widget_hot)
+    {
+        .widget = mover,
+        .jump_table = mover->jump_table,
+        .render_interface = mover->render_interface,
+    };
+
+    for (size_t i = first; i <= last; i++)
+        if (z_order[i].widget)
+            z_order[i].widget->z_index = i;
+
+    z_order_lock = lock ? lock->z_index : z_order_used;
+
+    // Only the mover is out of place in its subscriber lists
+    const unsigned int mask = widget_event_mask(mover);
+
+    for (size_t i = 0; i < WIDGET_EVENT_CNT; i++)
+        if (mask & (1u << i))
+            event_subscribers[i].unsorted = true;
+}
+
 // Move the mover widget behind the target widget.
 void widget_interface_move(struct widget_interface* mover, struct widget_interface* target)
 {
     if (mover == target)
         return;
 
+    struct widget* const internal_mover = (struct widget*)mover;
+    struct widget* const internal_target = (struct widget*)target;
+
+    const bool incremental = z_order_holds(internal_mover) && (!internal_target || z_order_holds(internal_target));
+
+    size_t to = z_order_used - 1;
+
+    if (internal_target)
+        to = internal_target->z_index > internal_mover->z_index ? internal_target->z_index - 1 : internal_target->z_index;
+
     // Only this function is visable to the widget writer.
     // Since poping a widget without calling gc isn't allowed.
     queue_pop(mover);
     queue_insert(mover, target);
+
+    if (incremental)
+    {
+        z_order_move(internal_mover, to);
+        z_order_dirty = false;
+    }
+
+    pick_epoch++;
 }
 
 /*********************************************/
@@ -253,6 +484,55 @@ static const double drag_threshold = 0.2;
 static ALLEGRO_SHADER* offscreen_shader;
 static ALLEGRO_BITMAP* offscreen_bitmap;
 
+// Pick spatial index variables
+// A screen space grid of the widget bounds, only widgets whose bounds hold the cursor get their masks drawn.
+#define PICK_CELL_SIZE 64
+
+struct pick_cell
+{
+    struct widget** widgets;
+    size_t used, allocated;
+};
+
+static struct pick_cell* pick_grid;
+static int pick_grid_width, pick_grid_height;
+static struct pick_cell pick_unbounded; // Widgets without dimensions, always candidates
+static struct keyframe pick_camera;
+static size_t pick_generation;
+
+// Pick epoch variables
+// The epoch advances when the cursor moves, the z-order changes, or a transform under the cursor changes.
+static size_t pick_result_epoch;
+static struct widget* pick_result;
+static int pick_cursor_x, pick_cursor_y;
+static size_t pick_revision;
+static bool pick_hide_hover;
+
+// Widget ID variables
+// A dense table of the widgets by ID so a picked ID maps straight to its widget, ID 0 means nothing.
+#define PICK_MAX_ID 0xFFFFFF
+
+static struct widget** widget_ids;
+static size_t widget_ids_used, widget_ids_allocated;
+static size_t* free_widget_ids;
+static size_t free_widget_ids_used;
+
+// Asynchronous pick readback variables
+// The pixel under the cursor is copied to a pixel buffer object and read on the next pick, so the GPU never stalls.
+#define PICK_MAX_CANDIDATES 256
+
+struct pick_readback
+{
+    GLuint buffer;
+    GLsync fence;
+    struct widget* candidates[PICK_MAX_CANDIDATES];
+    size_t candidate_cnt;
+    size_t epoch;
+};
+
+static struct pick_readback pick_readbacks[2];
+static size_t pick_readback_idx;
+
 // Miscellaneous 
 static int contex_callback = LUA_REFNIL;
 
@@ -297,7 +577,9 @@ static void draw_widget(const struct widget* const widget)
 {
     const struct render_interface* const render_interface = widget->render_interface;
     render_interface_predraw(render_interface);
-    widget->jump_table->draw((struct widget_interface*)widget);
+
+    if (!render_cache_composite(widget->cache, render_interface))
+        widget->jump_table->draw((struct widget_interface*)widget);
 #ifdef WIDGET_DEBUG_DRAW
     const double half_width = render_interface->half_width;
     const double half_height = render_interface->half_height;
@@ -307,6 +589,18 @@ static void draw_widget(const struct widget* const widget)
 #endif
 }
 
+// Draw the widget through the sprite batch if it can be instanced, otherwise flush the batch first to keep the order.
+static void draw_widget_batched(const struct widget* const widget)
+{
+    if (widget->jump_table->instance && sprite_batch_available() &&
+        render_interface_batched_predraw(widget->render_interface) &&
+        widget->jump_table->instance((const struct widget_interface*)widget))
+        return;
+
+    sprite_batch_flush();
+    draw_widget(widget);
+}
+
 // Update the transition_timestamp based on how far the widget is to the point.
 static inline void update_transition_timestamp(struct widget* widget, double x, double y)
 {
@@ -333,71 +627,737 @@ static inline void towards_drag()
     render_interface_push_keyframe(current_hover->render_interface, &keyframe);
 }
 
-// Handle picking mouse inputs using off screen drawing.
-static inline struct widget* pick(int x, int y)
+/*********************************************/
+/*              Widget IDs                   */
+/*********************************************/
+
+// Give the widget an ID, reusing freed IDs first. The ID is 0 if none are left.
+static void widget_id_assign(struct widget* const widget)
 {
-    ALLEGRO_BITMAP* original_bitmap = al_get_target_bitmap();
+    widget->pick.id = 0;
 
-    al_set_target_bitmap(offscreen_bitmap);
-    al_set_clipping_rectangle(x - 1, y - 1, 3, 3);
-    glDisable(GL_STENCIL_TEST);
+    if (free_widget_ids_used)
+    {
+        widget->pick.id = free_widget_ids[--free_widget_ids_used];
+        widget_ids[widget->pick.id] = widget;
 
-    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+        return;
+    }
 
-    al_use_shader(offscreen_shader);
+    if (widget_ids_used > PICK_MAX_ID)
+        return;
 
-    size_t picker_index = 1;
-    size_t pick_buffer;
-    float color_buffer[3];
+    if (widget_ids_allocated <= widget_ids_used)
+    {
+        const size_t new_cnt = 2 * widget_ids_allocated;
 
-    const bool hide_hover = hover_on_top();
+        struct widget** memsafe_hande = realloc(widget_ids, new_cnt * sizeof(struct widget*));
 
-    if (hide_hover)
-        queue_pop((struct widget_interface*)current_hover);
+        if (!memsafe_hande)
+            return;
+
+        widget_ids = memsafe_hande;
+
+        size_t* free_handle = realloc(free_widget_ids, new_cnt * sizeof(size_t));
+
+        if (!free_handle)
+            return;
+
+        free_widget_ids = free_handle;
+        widget_ids_allocated = new_cnt;
+    }
+
+    widget->pick.id = widget_ids_used++;
+    widget_ids[widget->pick.id] = widget;
+}
+
+// Make room for cnt more IDs
+static void widget_id_reserve(size_t cnt)
+{
+    size_t new_cnt = widget_ids_used + cnt;
+
+    if (new_cnt > PICK_MAX_ID + 1)
+        new_cnt = PICK_MAX_ID + 1;
+
+    if (widget_ids_allocated >= new_cnt)
+        return;
+
+    struct widget** memsafe_hande = realloc(widget_ids, new_cnt * sizeof(struct widget*));
+
+    if (!memsafe_hande)
+        return;
+
+    widget_ids = memsafe_hande;
+
+    size_t* free_handle = realloc(free_widget_ids, new_cnt * sizeof(size_t));
+
+    if (!free_handle)
+        return;
+
+    free_widget_ids = free_handle;
+    widget_ids_allocated = new_cnt;
+}
+
+static void widget_id_release(struct widget* const widget)
+{
+    if (widget->pick.id == 0)
+        return;
+
+    widget_ids[widget->pick.id] = NULL;
+    free_widget_ids[free_widget_ids_used++] = widget->pick.id;
+    widget->pick.id = 0;
+}
+
+/*********************************************/
+/*              Widget Hierarchy             */
+/*********************************************/
+
+// Whether the widget is hidden or inside a hidden or off screen container, memoized until cull_stamp advances.
+//  Children are expected to lie inside their container's bounds so only containers are bounds tested,
+//  which lets a whole off screen subtree be skipped for the cost of one test.
+static bool widget_culled(struct widget* const widget)
+{
+    if (widget->cull_stamp == cull_stamp)
+        return widget->culled;
+
+    widget->cull_stamp = cull_stamp;
+    widget->culled = widget->hidden ||
+        (widget->parent && widget_culled(widget->parent)) ||
+        (widget->children && render_interface_off_screen(widget->render_interface));
+
+    return widget->culled;
+}
+
+// The culling worked out by the last sweep, safe to read while the render_interfaces are being blended.
+static inline bool widget_was_culled(const struct widget* const widget)
+{
+    return widget->cull_stamp == cull_stamp && widget->culled;
+}
+
+// Reparent the widget, NULL makes it a root. Parenting that would make a cycle is refused.
+static bool widget_set_parent(struct widget* const widget, struct widget* const parent)
+{
+    for (const struct widget* ancestor = parent; ancestor; ancestor = ancestor->parent)
+        if (ancestor == widget)
+            return false;
+
+    if (widget->parent)
+        widget->parent->children--;
+
+    widget->parent = parent;
+    render_interface_set_parent(widget->render_interface, parent ? parent->render_interface : NULL);
+
+    if (parent)
+        parent->children++;
+
+    cull_stamp++;
+    pick_epoch++;
+
+    return true;
+}
+
+// Orphan the widget's children, they become roots
+static void widget_orphan_children(struct widget* const widget)
+{
+    for (struct widget* child = queue_head; child && widget->children; child = child->next)
+        if (child->parent == widget)
+            widget_set_parent(child, NULL);
+}
+
+/*********************************************/
+/*             Update Scheduling             */
+/*********************************************/
+
+static void awake_push(struct widget* const widget)
+{
+    if (widget->awake || !widget->jump_table->update)
+        return;
+
+    if (awake_allocated <= awake_used)
+    {
+        const size_t new_cnt = awake_allocated ? 2 * awake_allocated : 64;
+
+        struct widget** memsafe_hande = realloc(awake, new_cnt * sizeof(struct widget*));
+
+        if (!memsafe_hande)
+            return;
+
+        awake = memsafe_hande;
+        awake_allocated = new_cnt;
+    }
+
+    awake[awake_used++] = widget;
+    widget->awake = true;
+}
+
+static void awake_remove(struct widget* const widget)
+{
+    if (!widget->awake)
+        return;
+
+    for (size_t i = 0; i < awake_used; i++)
+        if (awake[i] == widget)
+        {
+            awake[i] = NULL;
+            break;
+        }
+
+    widget->awake = false;
+}
+
+// Ask for the widget to be updated next frame.
+//  Widgets with update_on_demand drop out of the updates as soon as a frame passes without a wake,
+//  so an update that still has work calls this for itself. From an update only the widget itself can be woken.
+void widget_interface_wake(struct widget_interface* const widget_interface)
+{
+    struct widget* const widget = (struct widget*)widget_interface;
+
+    widget->keep_awake = true;
+    awake_push(widget);
+}
+
+// Tell the engine the widget's size or what its mask draws changed after it was made, picking and culling can't see either.
+void widget_interface_reshape(struct widget_interface* const widget_interface)
+{
+    (void)widget_interface;
+
+    cull_stamp++;
+    pick_epoch++;
+}
+
+// Ask for the widget's render cache to be redrawn, widgets with cache_draw call this whenever their look changes.
+//  Resizing and scaling are noticed without it.
+void widget_interface_invalidate(struct widget_interface* const widget_interface)
+{
+    render_cache_invalidate(((struct widget*)widget_interface)->cache);
+}
+
+/*********************************************/
+/*              Widget Pools                 */
+/*********************************************/
+
+// Take a collected struct from the pool, or malloc one if the pool is empty
+void* widget_pool_alloc(struct widget_pool* const pool, size_t size)
+{
+    if (pool->used)
+        return pool->free[--pool->used];
+
+    return malloc(size);
+}
+
+// Keep the struct for the next widget of the same type, freeing it if the pool can't grow
+void widget_pool_free(struct widget_pool* const pool, void* ptr)
+{
+    if (!ptr)
+        return;
+
+    if (pool->allocated <= pool->used)
+    {
+        const size_t new_cnt = pool->allocated ? 2 * pool->allocated : 16;
+
+        void** memsafe_hande = realloc(pool->free, new_cnt * sizeof(void*));
+
+        if (!memsafe_hande)
+        {
+            free(ptr);
+            return;
+        }
+
+        pool->free = memsafe_hande;
+        pool->allocated = new_cnt;
+    }
+
+    pool->free[pool->used++] = ptr;
+}
+
+/*********************************************/
+/*            Event Subscribers              */
+/*********************************************/
+
+static void event_subscribe(struct widget* const widget)
+{
+    const unsigned int mask = widget_event_mask(widget);
+
+    for (size_t i = 0; i < WIDGET_EVENT_CNT; i++)
+    {
+        struct event_subscribers* const subscribers = event_subscribers + i;
+
+        if (!(mask & (1u << i)))
+            continue;
+
+        if (subscribers->allocated <= subscribers->used)
+        {
+            const size_t new_cnt = subscribers->allocated ? 2 * subscribers->allocated : 8;
+
+            struct widget** memsafe_hande = realloc(subscribers->widgets, new_cnt * sizeof(struct widget*));
+
+            if (!memsafe_hande)
+                continue;
+
+            subscribers->widgets = memsafe_hande;
+            subscribers->allocated = new_cnt;
+        }
+
+        subscribers->widgets[subscribers->used++] = widget;
+    }
+
+    event_subscribers_unsorted = true;
+}
+
+// Clear the widget's slots, safe to call mid dispatch
+static void event_unsubscribe(struct widget* const widget)
+{
+    const unsigned int mask = widget_event_mask(widget);
+
+    for (size_t i = 0; i < WIDGET_EVENT_CNT; i++)
+    {
+        struct event_subscribers* const subscribers = event_subscribers + i;
+
+        if (!(mask & (1u << i)))
+            continue;
+
+        for (size_t j = 0; j < subscribers->used; j++)
+            if (subscribers->widgets[j] == widget)
+            {
+                subscribers->widgets[j] = NULL;
+                subscribers->dirty = true;
+                break;
+            }
+    }
+}
+
+static int z_index_compare(const void* a, const void* b)
+{
+    const size_t z_a = (*(const struct widget**)a)->z_index;
+    const size_t z_b = (*(const struct widget**)b)->z_index;
 
-    for (struct widget* widget = lock; widget; widget = widget->next, picker_index++)
+    return (z_a > z_b) - (z_a < z_b);
+}
+
+// Compact cleared slots and restore z-order, z_order must be fresh
+static void event_subscribers_refresh()
+{
+    for (size_t i = 0; i < WIDGET_EVENT_CNT; i++)
+    {
+        struct event_subscribers* const subscribers = event_subscribers + i;
+
+        if (subscribers->dirty)
+        {
+            size_t used = 0;
+
+            for (size_t j = 0; j < subscribers->used; j++)
+                if (subscribers->widgets[j])
+                    subscribers->widgets[used++] = subscribers->widgets[j];
+
+            subscribers->used = used;
+            subscribers->dirty = false;
+        }
+
+        if (event_subscribers_unsorted)
+            qsort(subscribers->widgets, subscribers->used, sizeof(struct widget*), z_index_compare);
+        else if (subscribers->unsorted)
+            for (size_t j = 1; j < subscribers->used; j++)
+            {
+                struct widget* const widget = subscribers->widgets[j];
+                size_t k = j;
+
+                // Nearly sorted, so each widget only walks past the moved ones
+                for (; k > 0 && subscribers->widgets[k - 1]->z_index > widget->z_index; k--)
+                    subscribers->widgets[k] = subscribers->widgets[k - 1];
+
+                subscribers->widgets[k] = widget;
+            }
+
+        subscribers->unsorted = false;
+    }
+
+    event_subscribers_unsorted = false;
+}
+
+static enum WIDGET_EVENT event_class(const ALLEGRO_EVENT* const event)
+{
+    switch (event->type)
+    {
+    case ALLEGRO_EVENT_KEY_DOWN:
+    case ALLEGRO_EVENT_KEY_UP:
+    case ALLEGRO_EVENT_KEY_CHAR:
+        return WIDGET_EVENT_KEYBOARD;
+
+    case ALLEGRO_EVENT_MOUSE_AXES:
+    case ALLEGRO_EVENT_MOUSE_WARPED:
+        return WIDGET_EVENT_MOUSE_AXES;
+
+    case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+    case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+        return WIDGET_EVENT_MOUSE_BUTTON;
+
+    case ALLEGRO_EVENT_TIMER:
+        return WIDGET_EVENT_TIMER;
+
+    default:
+        return WIDGET_EVENT_OTHER;
+    }
+}
+
+/*********************************************/
+/*           Pick Spatial Index              */
+/*********************************************/
+
+static void pick_cell_push(struct pick_cell* const cell, struct widget* const widget)
+{
+    if (cell->allocated <= cell->used)
     {
-        pick_buffer = picker_index;
+        const size_t new_cnt = cell->allocated ? 2 * cell->allocated : 4;
+
+        struct widget** memsafe_hande = realloc(cell->widgets, new_cnt * sizeof(struct widget*));
+
+        if (!memsafe_hande)
+            return;
+
+        cell->widgets = memsafe_hande;
+        cell->allocated = new_cnt;
+    }
+
+    cell->widgets[cell->used++] = widget;
+}
 
-        for (size_t i = 0; i < 3; i++)
+static void pick_cell_remove(struct pick_cell* const cell, const struct widget* const widget)
+{
+    for (size_t i = 0; i < cell->used; i++)
+        if (cell->widgets[i] == widget)
         {
-            color_buffer[i] = ((float)(pick_buffer % 200)) / 200;
-            pick_buffer /= 200;
+            cell->widgets[i] = cell->widgets[--cell->used];
+            return;
         }
+}
+
+// Take the widget out of the grid
+static void pick_index_remove(struct widget* const widget)
+{
+    if (!widget->pick.indexed)
+        return;
+
+    widget->pick.indexed = false;
+
+    if (widget->pick.cell_x0 < 0)
+    {
+        pick_cell_remove(&pick_unbounded, widget);
+        return;
+    }
+
+    for (int j = widget->pick.cell_y0; j <= widget->pick.cell_y1; j++)
+        for (int i = widget->pick.cell_x0; i <= widget->pick.cell_x1; i++)
+            pick_cell_remove(pick_grid + j * pick_grid_width + i, widget);
+}
+
+// Put the widget into every cell its transformed bounds overlap
+static void pick_index_insert(struct widget* const widget)
+{
+    const struct render_interface* const render_interface = widget->render_interface;
+
+    widget->pick.keyframe = render_interface->current;
+
+    if (render_interface->parent)
+        widget->pick.parent_transform = *render_interface_world_transform(render_interface->parent);
+
+    widget->pick.half_width = render_interface->half_width;
+    widget->pick.half_height = render_interface->half_height;
+    widget->pick.indexed = true;
+
+    if (render_interface->half_width == 0 || render_interface->half_height == 0)
+    {
+        widget->pick.cell_x0 = -1;
+        pick_cell_push(&pick_unbounded, widget);
+        return;
+    }
+
+    const ALLEGRO_TRANSFORM* const transform = render_interface_world_transform(render_interface);
+
+    // A GPU evaluated widget is drawn somewhere between current and the end of its segment, so it's indexed over both
+    struct keyframe destination;
+    ALLEGRO_TRANSFORM destination_transform;
+    const bool sweep = render_interface_gpu_destination(render_interface, &destination);
+
+    if (sweep)
+        keyframe_build_transform(&destination, &destination_transform);
+
+    float x[8] = { -render_interface->half_width, render_interface->half_width, render_interface->half_width, -render_interface->half_width };
+    float y[8] = { -render_interface->half_height, -render_interface->half_height, render_interface->half_height, render_interface->half_height };
+
+    memcpy(x + 4, x, 4 * sizeof(float));
+    memcpy(y + 4, y, 4 * sizeof(float));
+
+    widget->pick.min_x = FLT_MAX, widget->pick.min_y = FLT_MAX;
+    widget->pick.max_x = -FLT_MAX, widget->pick.max_y = -FLT_MAX;
+
+    for (size_t i = 0; i < (sweep ? 8 : 4); i++)
+    {
+        al_transform_coordinates(i < 4 ? transform : &destination_transform, x + i, y + i);
+
+        widget->pick.min_x = fminf(widget->pick.min_x, x[i]), widget->pick.max_x = fmaxf(widget->pick.max_x, x[i]);
+        widget->pick.min_y = fminf(widget->pick.min_y, y[i]), widget->pick.max_y = fmaxf(widget->pick.max_y, y[i]);
+    }
+
+    // Clamp to the grid, an empty range means the widget is off screen
+    widget->pick.cell_x0 = (int)fmaxf(0, floorf(widget->pick.min_x / PICK_CELL_SIZE));
+    widget->pick.cell_y0 = (int)fmaxf(0, floorf(widget->pick.min_y / PICK_CELL_SIZE));
+    widget->pick.cell_x1 = (int)fminf(pick_grid_width - 1, floorf(widget->pick.max_x / PICK_CELL_SIZE));
+    widget->pick.cell_y1 = (int)fminf(pick_grid_height - 1, floorf(widget->pick.max_y / PICK_CELL_SIZE));
+
+    for (int j = widget->pick.cell_y0; j <= widget->pick.cell_y1; j++)
+        for (int i = widget->pick.cell_x0; i <= widget->pick.cell_x1; i++)
+            pick_cell_push(pick_grid + j * pick_grid_width + i, widget);
+}
+
+// Whether a child's parent transform changed since it was indexed
+static bool pick_parent_moved(const struct widget* const widget)
+{
+    const ALLEGRO_TRANSFORM* const transform = render_interface_world_transform(widget->render_interface->parent);
+
+    return 0 != memcmp(transform, &widget->pick.parent_transform, sizeof(ALLEGRO_TRANSFORM));
+}
+
+// Whether the cached bounds of an indexed widget hold the point
+static inline bool pick_bounds_contain(const struct widget* const widget, int x, int y)
+{
+    return widget->pick.indexed && (widget->pick.cell_x0 < 0 ||
+        (x >= widget->pick.min_x && x <= widget->pick.max_x && y >= widget->pick.min_y && y <= widget->pick.max_y));
+}
+
+// Refit the grid for the widgets that moved since the last pick and record the draw order.
+//  Widgets outside the pickable part of the queue, skipped or culled keep a stale generation so they're never candidates.
+//  Returns whether a widget moved onto or off of the point.
+static bool pick_index_refit(int x, int y, bool camera_moved, const struct widget* const skip)
+{
+    bool under_point = false;
+
+    pick_generation++;
+
+    z_order_refresh();
+
+    for (const struct widget_hot* hot = z_order + z_order_lock; hot != z_order + z_order_used; hot++)
+    {
+        struct widget* const widget = hot->widget;
+        const struct render_interface* const render_interface = hot->render_interface;
+
+        if (!widget || widget == skip || widget_culled(widget))
+            continue;
+
+        widget->pick.generation = pick_generation;
+
+        if (widget->pick.indexed &&
+            widget->pick.half_width == render_interface->half_width &&
+            widget->pick.half_height == render_interface->half_height &&
+            !(camera_moved && render_interface->current.camera >= 0.0) &&
+            0 == memcmp(&widget->pick.keyframe, &render_interface->current, sizeof(struct keyframe)) &&
+            !(render_interface->parent && pick_parent_moved(widget)))
+            continue;
+
+        under_point |= pick_bounds_contain(widget, x, y);
+
+        pick_index_remove(widget);
+        pick_index_insert(widget);
+
+        under_point |= pick_bounds_contain(widget, x, y);
+    }
+
+    return under_point;
+}
+
+// Gather the widgets whose bounds hold the point, in draw order.
+static size_t pick_index_query(int x, int y, struct widget** const candidates, size_t max_candidates)
+{
+    size_t used = 0;
+
+    const struct pick_cell* cells[2] = { &pick_unbounded, NULL };
+
+    if (x >= 0 && y >= 0 && x / PICK_CELL_SIZE < pick_grid_width && y / PICK_CELL_SIZE < pick_grid_height)
+        cells[1] = pick_grid + (y / PICK_CELL_SIZE) * pick_grid_width + x / PICK_CELL_SIZE;
+
+    for (size_t c = 0; c < 2 && cells[c]; c++)
+        for (size_t i = 0; i < cells[c]->used && used < max_candidates; i++)
+        {
+            struct widget* const widget = cells[c]->widgets[i];
+
+            if (widget->pick.generation != pick_generation)
+                continue;
+
+            if (widget->pick.cell_x0 >= 0 &&
+                (x < widget->pick.min_x || x > widget->pick.max_x || y < widget->pick.min_y || y > widget->pick.max_y))
+                continue;
+
+            // Insertion sort by draw order, there are only ever a handful
+            size_t j = used++;
+
+            for (; j > 0 && candidates[j - 1]->z_index > widget->z_index; j--)
+                candidates[j] = candidates[j - 1];
+
+            candidates[j] = widget;
+        }
+
+    return used;
+}
+
+// Drop the pending readbacks, their IDs could be handed out again before they resolve.
+static void pick_readback_cancel()
+{
+    for (size_t i = 0; i < 2; i++)
+        if (pick_readbacks[i].fence)
+        {
+            glDeleteSync(pick_readbacks[i].fence);
+            pick_readbacks[i].fence = NULL;
+        }
+}
+
+// Read the result of an earlier pick into result, NULL if there wasn't one or the widget is no longer pickable.
+//  The fence is only polled, false if the GPU hasn't finished the copy yet and the readback stays pending.
+static bool pick_readback_resolve(struct pick_readback* const readback, struct widget** const result)
+{
+    if (readback->fence)
+    {
+        const GLenum status = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+    }
+
+    *result = NULL;
+
+    if (!readback->fence)
+        return true;
+
+    glDeleteSync(readback->fence);
+    readback->fence = NULL;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+    const unsigned char* const pixel = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+    // The ID is written as little endian bytes, see widget.vert
+    const size_t id = pixel ? pixel[0] | (pixel[1] << 8) | (pixel[2] << 16) : 0;
 
-        al_set_shader_float_vector("picker_color", 3, color_buffer, 1);
-        render_interface_use_transform(widget->render_interface);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-        call_engine(widget, mask);
+    if (id == 0 || id >= widget_ids_used)
+        return true;
+
+    struct widget* const widget = widget_ids[id];
+
+    if (widget && widget->pick.generation == pick_generation)
+        *result = widget;
+
+    return true;
+}
+
+// Draw the candidate masks under the point and queue the readback, see pick.
+static void pick_issue(int x, int y)
+{
+    struct pick_readback* const issue = pick_readbacks + pick_readback_idx;
+
+    pick_readback_idx ^= 1;
+
+    issue->epoch = pick_epoch;
+    issue->candidate_cnt = pick_index_query(x, y, issue->candidates, PICK_MAX_CANDIDATES);
+
+    // Nothing under the point is known right away
+    if (issue->candidate_cnt == 0)
+    {
+        pick_result = NULL;
+        pick_result_epoch = pick_epoch;
+
+        return;
+    }
+
+    ALLEGRO_BITMAP* original_bitmap = al_get_target_bitmap();
+
+    // The shadowed state belongs to the display's backbuffer
+    al_set_target_bitmap(offscreen_bitmap);
+    render_state_invalidate();
+    al_set_clipping_rectangle(x - 1, y - 1, 3, 3);
+    glDisable(GL_STENCIL_TEST);
+
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+    al_use_shader(offscreen_shader);
+
+    for (size_t c = 0; c < issue->candidate_cnt; c++)
+    {
+        struct widget* const candidate = issue->candidates[c];
+
+        al_set_shader_int("picker_id", (int)candidate->pick.id);
+        render_interface_sync(candidate->render_interface);
+        render_interface_use_transform(candidate->render_interface);
+
+        call_engine(candidate, mask);
     }
 
+    // Queue the copy of the pixel (GL rows are bottom up)
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, issue->buffer);
+    glReadPixels(x, al_get_bitmap_height(offscreen_bitmap) - 1 - y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    issue->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
     al_set_target_bitmap(original_bitmap);
+    render_state_invalidate();
+}
+
+// Handle picking mouse inputs using off screen drawing.
+//  Only the masks of the spatial index candidates are drawn, and the result is read back a pick later.
+//  While the pick epoch holds still the last result is reused without touching the index or the GPU.
+static inline struct widget* pick(int x, int y)
+{
+    const bool hide_hover = hover_on_top();
 
-    al_unmap_rgb_f(al_get_pixel(offscreen_bitmap, x, y),
-        color_buffer, color_buffer + 1, color_buffer + 2);
+    struct keyframe camera;
+    camera_copy_current(&camera);
 
-    size_t index = round(200 * color_buffer[0]) +
-        200 * round(200 * color_buffer[1]) +
-        40000 * round(200 * color_buffer[2]);
+    const bool camera_moved = camera.x != pick_camera.x || camera.y != pick_camera.y ||
+        camera.sx != pick_camera.sx || camera.sy != pick_camera.sy || camera.theta != pick_camera.theta;
 
-    if (index == 0)
+    if (x != pick_cursor_x || y != pick_cursor_y || hide_hover != pick_hide_hover)
     {
-        if (hide_hover)
-            queue_insert((struct widget_interface*)current_hover, (struct widget_interface*)current_hover->next);
+        pick_cursor_x = x;
+        pick_cursor_y = y;
+        pick_hide_hover = hide_hover;
 
-        return NULL;
+        pick_epoch++;
     }
 
-    struct widget* widget = lock;
+    // The current keyframes of GPU evaluated widgets lag what's drawn, so they're picked again each time
+    if (render_interface_gpu_moving())
+        pick_epoch++;
 
-    while (index-- > 1 && widget)
-        widget = widget->next;
+    const size_t revision = render_interface_revision();
+    struct pick_readback* const pending = pick_readbacks + (pick_readback_idx ^ 1);
 
-    if (hide_hover)
-        queue_insert((struct widget_interface*)current_hover, (struct widget_interface*)current_hover->next);
+    if (revision == pick_revision && !camera_moved && 
+        pick_epoch == pick_result_epoch && !pending->fence)
+        return pick_result;
+
+    // The lifted hover can't be under itself
+    if (pick_index_refit(x, y, camera_moved, hide_hover ? current_hover : NULL))
+        pick_epoch++;
+
+    pick_revision = revision;
+    pick_camera = camera;
+
+    // Until the GPU catches up the last result stands, only one readback is in flight at a time
+    if (pending->fence)
+    {
+        const size_t epoch = pending->epoch;
 
-    return widget;
+        if (!pick_readback_resolve(pending, &pick_result))
+            return pick_result;
+
+        if (epoch == pick_epoch)
+            pick_result_epoch = pick_epoch;
+    }
+
+    if (pick_epoch != pick_result_epoch)
+        pick_issue(x, y);
+
+    return pick_result;
 }
 
 // Updates and calls any callbacks for the last_click, current_hover, current_drop pointers
@@ -464,92 +1424,238 @@ static inline void update_drag_pointers()
 				snap_target.dy += snap_offset_y;
                 snap_target.timestamp = current_timestamp + 0.1;
 
-				render_interface_push_keyframe(current_hover->render_interface, &snap_target);
+				render_interface_push_keyframe(current_hover->render_interface, &snap_target);
+
+				widget_engine_state = ENGINE_STATE_TO_SNAP;
+			}
+            else
+            {
+                towards_drag();
+                widget_engine_state = ENGINE_STATE_TO_DRAG;
+            }
+		}
+		else
+		{
+            if (current_drop && current_drop->is_snappable)
+            {
+                towards_drag();
+                widget_engine_state = ENGINE_STATE_TO_DRAG;
+            }
+            else
+				widget_engine_state = ENGINE_STATE_DRAG;
+		}
+
+        current_drop = new_pointer;
+
+        return;
+    }
+}
+
+// Convert a screen position to the cordinate used when drawng, main thread only (see widget_screen_to_local_cached)
+void widget_screen_to_local(const struct widget_interface* const widget, double* x, double* y)
+{
+    // The allegro uses float but standards have moved forward to doubles.
+    // This is the easist solution.
+    float _x = *x;
+    float _y = *y;
+
+    // The inverse is cached on the render_interface
+    al_transform_coordinates(render_interface_world_inverse(widget->render_interface), &_x, &_y);
+
+    *x = _x;
+    *y = _y;
+}
+
+// widget_screen_to_local for widget updates on the thread pool, uses the transforms as of the start of the update.
+void widget_screen_to_local_cached(const struct widget_interface* const widget, double* x, double* y)
+{
+    float _x = *x;
+    float _y = *y;
+
+    ALLEGRO_TRANSFORM inverse;
+    render_interface_world_cached(widget->render_interface, &inverse);
+    al_transform_coordinates(&inverse, &_x, &_y);
+
+    *x = _x;
+    *y = _y;
+}
+
+// Check that a widget has the right jumptable
+struct widget_interface* check_widget(struct widget_interface* widget, const struct widget_jump_table* const jump_table)
+{
+    return (((struct widget*)widget)->jump_table == jump_table) ? (struct widget_interface*) widget : NULL;
+}
+
+/*********************************************/
+/*            Big Four Callbacks             */
+/*********************************************/
+
+// Draw the widgets in queue order.
+// The later a widget is in the queue the nearer it is, -1 to 1 exclusive
+static inline float widget_depth(size_t z_index)
+{
+    return 1.0f - 2.0f * (z_index + 1) / (z_order_used + 1);
+}
+
+// Group by type then batch key, front to back within a batch so covered pixels are rejected early
+static int depth_draw_compare(const void* a, const void* b)
+{
+    const struct depth_draw* const draw_a = (const struct depth_draw*)a;
+    const struct depth_draw* const draw_b = (const struct depth_draw*)b;
+
+    const uintptr_t type_a = (uintptr_t)draw_a->widget->jump_table;
+    const uintptr_t type_b = (uintptr_t)draw_b->widget->jump_table;
+
+    if (type_a != type_b)
+        return type_a < type_b ? -1 : 1;
+
+    if (draw_a->key != draw_b->key)
+        return draw_a->key < draw_b->key ? -1 : 1;
+
+    return (draw_a->widget->z_index < draw_b->widget->z_index) - (draw_a->widget->z_index > draw_b->widget->z_index);
+}
+
+// Set the alpha test for both normal and batched drawing
+static void depth_sort_alpha_test(int function, int value)
+{
+    render_state_alpha_test(function, value);
+    sprite_batch_alpha_test(function, value);
+}
+
+// Draw the opaque widgets sorted by state with the depth test keeping them in order,
+//  then the translucent widgets and the opaque widgets' antialiased fringes back to front. False if there wasn't memory to sort.
+static bool draw_depth_sorted(const struct widget* const skip)
+{
+    size_t opaque_used = 0;
+
+    for (const struct widget_hot* hot = z_order; hot != z_order + z_order_used; hot++)
+    {
+        if (!hot->widget || hot->widget == skip || !hot->jump_table->batch_key || widget_culled(hot->widget))
+            continue;
+
+        const size_t key = hot->jump_table->batch_key((struct widget_interface*)hot->widget);
+
+        if (!key)
+            continue;
+
+        if (depth_draws_allocated <= opaque_used)
+        {
+            const size_t new_cnt = depth_draws_allocated ? 2 * depth_draws_allocated : 64;
+
+            struct depth_draw* memsafe_hande = realloc(depth_draws, new_cnt * sizeof(struct depth_draw));
+
+            if (!memsafe_hande)
+                return false;
+
+            depth_draws = memsafe_hande;
+            depth_draws_allocated = new_cnt;
+        }
+
+        depth_draws[opaque_used++] = (struct depth_draw)
+        {
+            .widget = hot->widget,
+            .key = key,
+            .depth = widget_depth(hot - z_order),
+        };
+    }
 
-				widget_engine_state = ENGINE_STATE_TO_SNAP;
-			}
-            else
-            {
-                towards_drag();
-                widget_engine_state = ENGINE_STATE_TO_DRAG;
-            }
-		}
-		else
-		{
-            if (current_drop && current_drop->is_snappable)
-            {
-                towards_drag();
-                widget_engine_state = ENGINE_STATE_TO_DRAG;
-            }
-            else
-				widget_engine_state = ENGINE_STATE_DRAG;
-		}
+    qsort(depth_draws, opaque_used, sizeof(struct depth_draw), depth_draw_compare);
 
-        current_drop = new_pointer;
+    render_state_depth_test(true);
+    render_state_depth_write(true);
 
-        return;
+    // Only the mostly opaque texels write depth, partly transparent edges would hide what's behind them
+    depth_sort_alpha_test(ALLEGRO_RENDER_GREATER, DEPTH_SORT_ALPHA_CUTOFF);
+
+    for (const struct depth_draw* draw = depth_draws; draw != depth_draws + opaque_used; draw++)
+    {
+        render_state_float(RENDER_STATE_UNIFORM_depth, draw->depth);
+        sprite_batch_depth(draw->depth);
+        draw_widget_batched(draw->widget);
     }
-}
 
-// Convert a screen position to the cordinate used when drawng
-void widget_screen_to_local(const struct widget_interface* const widget, double* x, double* y)
-{
-    ALLEGRO_TRANSFORM transform;
+    sprite_batch_flush();
 
-    // The allegro uses float but standards have moved forward to doubles.
-    // This is the easist solution.
-    float _x = *x;
-    float _y = *y;
+    // Everything blended is drawn back to front, tested against the opaque texels without hiding each other.
+    //  The opaque widgets are drawn again for their antialiased fringes, the texels the first pass left out.
+    render_state_depth_write(false);
 
-    keyframe_build_transform(&widget->render_interface->current, &transform);
+    for (const struct widget_hot* hot = z_order; hot != z_order + z_order_used; hot++)
+    {
+        if (!hot->widget || hot->widget == skip || widget_culled(hot->widget))
+            continue;
 
-    // WARNING: the inbuilt invert only works for 2D transforms
-    if (1)
-        al_invert_transform(&transform);
-    else
-        invert_transform_3D(&transform);
+        if (hot->jump_table->batch_key && hot->jump_table->batch_key((struct widget_interface*)hot->widget))
+            depth_sort_alpha_test(ALLEGRO_RENDER_LESS_EQUAL, DEPTH_SORT_ALPHA_CUTOFF);
+        else
+            depth_sort_alpha_test(ALLEGRO_RENDER_ALWAYS, 0);
 
+        render_state_float(RENDER_STATE_UNIFORM_depth, widget_depth(hot - z_order));
+        sprite_batch_depth(widget_depth(hot - z_order));
+        draw_widget_batched(hot->widget);
+    }
 
-    al_transform_coordinates(&transform, &_x, &_y);
+    sprite_batch_flush();
+    sprite_batch_depth(0);
 
-    *x = _x;
-    *y = _y;
+    // Back to the display's alpha test, see main
+    depth_sort_alpha_test(ALLEGRO_RENDER_NOT_EQUAL, 0);
+    render_state_depth_write(true);
+    render_state_depth_test(false);
+    render_state_float(RENDER_STATE_UNIFORM_depth, 0);
+
+    return true;
 }
 
-// Check that a widget has the right jumptable
-struct widget_interface* check_widget(struct widget_interface* widget, const struct widget_jump_table* const jump_table)
+// Draw a widget into its render cache
+static void cache_draw(const void* widget)
 {
-    return (((struct widget*)widget)->jump_table == jump_table) ? (struct widget_interface*) widget : NULL;
+    ((const struct widget*)widget)->jump_table->draw((const struct widget_interface*)widget);
 }
 
-/*********************************************/
-/*            Big Four Callbacks             */
-/*********************************************/
+// Render the stale caches of the widgets about to be drawn, this switches target bitmaps so it's done before drawing starts.
+static void render_caches_prepare()
+{
+    render_cache_frame();
+
+    for (const struct widget_hot* hot = z_order; hot != z_order + z_order_used; hot++)
+        if (hot->widget && hot->jump_table->cache_draw && !widget_culled(hot->widget))
+            render_cache_prepare(&hot->widget->cache, hot->render_interface, cache_draw, hot->widget);
+}
 
-// Draw the widgets in queue order.
 void widget_engine_draw()
 {
-    render_interface_global_predraw();
-
     const bool hide_hover = hover_on_top();
+    const struct widget* const skip = hide_hover ? current_hover : NULL;
 
-    if (hide_hover)
-        queue_pop((struct widget_interface*)current_hover);
+    z_order_refresh();
+    cull_stamp++;
+
+    // Widgets that won't be drawn only need their animations blended at the reduced rate
+    for (const struct widget_hot* hot = z_order; hot != z_order + z_order_used; hot++)
+        if (hot->widget && hot->widget != skip && widget_culled(hot->widget))
+            render_interface_lod_unseen(hot->render_interface);
+
+    render_caches_prepare();
+    render_interface_global_predraw();
 
     // Maybe add a second pass for stencil effect?
-    for (struct widget* widget = queue_head; widget; widget = widget->next)
-        draw_widget(widget);
+    if (!depth_sort || !draw_depth_sorted(skip))
+    {
+        for (const struct widget_hot* hot = z_order; hot != z_order + z_order_used; hot++)
+            if (hot->widget && hot->widget != skip && !widget_culled(hot->widget))
+                draw_widget_batched(hot->widget);
+
+        sprite_batch_flush();
+    }
 
     if (hide_hover)
-    {
-        queue_insert((struct widget_interface*)current_hover, (struct widget_interface*)current_hover->next);
         draw_widget(current_hover);
-    }
 
 #ifdef WIDGET_DEBUG_DRAW
-    al_use_shader(NULL);
-    glDisable(GL_STENCIL_TEST);
-    al_use_transform(&identity_transform);
+    render_state_use_shader(NULL);
+    render_state_stencil_test(false);
+    render_state_transform(&identity_transform);
 
     al_draw_textf(debug_font, al_map_rgb_f(0, 1, 0), 10, 10, ALLEGRO_ALIGN_LEFT,
         "State: %s", engine_state_str[widget_engine_state]);
@@ -566,6 +1672,9 @@ void widget_engine_draw()
 // Update the widget engine state
 void widget_engine_update()
 {
+    // The keyframes are blended by now, so the world transforms can be brought up to date for the rest of the frame
+    render_interface_refresh_transforms();
+
     if (widget_engine_state == ENGINE_STATE_LOCKED)
         return;
 
@@ -623,27 +1732,67 @@ void widget_engine_update()
     }
 }
 
-// Make a work queue with only the widgets that have an update method.
+// Make a work queue with only the awake widgets, dropping the on demand widgets that weren't woken.
+//  Locked out or culled widgets stay awake without being updated.
 struct work_queue* widget_engine_widget_work()
 {
     struct work_queue* work_queue = work_queue_create();
 
-    // Since the update method doesn't change maybe we should have a static queue?
     if (widget_engine_state != ENGINE_STATE_LOCKED)
-		for (struct widget* widget = lock; widget; widget = widget->next)
-			if (widget->jump_table->update)
-				work_queue_push(work_queue, widget->jump_table->update, widget);
+    {
+        z_order_refresh();
+
+        size_t used = 0;
+
+        for (size_t i = 0; i < awake_used; i++)
+        {
+            struct widget* const widget = awake[i];
+
+            if (!widget)
+                continue;
+
+            if (widget->jump_table->update_on_demand && !widget->keep_awake)
+            {
+                widget->awake = false;
+                continue;
+            }
+
+            awake[used++] = widget;
+
+            if (widget->z_index < z_order_lock || widget_was_culled(widget))
+                continue;
+
+            widget->keep_awake = false;
+            work_queue_push(work_queue, widget->jump_table->update, widget);
+        }
+
+        awake_used = used;
+    }
 
     return work_queue;
 }
 
-// Handle events by calling all widgets that have a event handler.
+// Handle events by calling the widgets subscribed to the event's class.
 void widget_engine_event_handler()
 {
-    // TODO: Incorperate to the threadpool?
-    if(widget_engine_state != ENGINE_STATE_LOCKED)
-		for (struct widget* widget = lock; widget; widget = widget->next)
-			call_engine(widget, event_handler);
+    if (widget_engine_state != ENGINE_STATE_LOCKED)
+    {
+        z_order_refresh();
+        event_subscribers_refresh();
+
+        const struct event_subscribers* const subscribers = event_subscribers + event_class(&current_event);
+
+        // Handlers can unsubscribe widgets, cleared slots are skipped and widgets subscribed mid dispatch wait for the next event
+        const size_t used = subscribers->used;
+
+        for (size_t i = 0; i < used; i++)
+        {
+            struct widget* const widget = subscribers->widgets[i];
+
+            if (widget && widget->z_index >= z_order_lock)
+                widget->jump_table->event_handler((struct widget_interface*)widget);
+        }
+    }
 
     switch (current_event.type)
     {
@@ -830,9 +1979,10 @@ static int set_keyframes(lua_State* L)
         keyframe_default(&keyframe);
         lua_tokeyframe(L, &keyframe);
 
-        lua_settop(L, -2);
-
         render_interface_push_keyframe(widget->render_interface, &keyframe);
+        lua_tointerpolation(L, -1, widget->render_interface);
+
+        lua_settop(L, -2);
         
         lua_geti(L, -1, i);
     }
@@ -876,6 +2026,8 @@ static int push_keyframe(lua_State* L)
     lua_tokeyframe(L,&keyframe);
 
     render_interface_push_keyframe(widget->render_interface, &keyframe);
+    lua_tointerpolation(L, -1, widget->render_interface);
+
 	return 0;
 }
 
@@ -900,17 +2052,78 @@ static int enter_loop(lua_State* L)
     return 0;
 }
 
+// Play a shared animation clip
+// Optionally reads a table with the start (relative to now), offset keyframe, and scale keyframe.
+static int play_clip(lua_State* L)
+{
+    struct widget_interface* const widget = (struct widget_interface*)luaL_checkudata(L, 1, "widget_mt");
+    struct tweener_clip* const clip = lua_toanimationclip(L, 2);
+
+    const struct keyframe zero = { 0 };
+    const struct keyframe one = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+    struct keyframe offset = zero;
+    struct keyframe scale = one;
+    double start = 0;
+
+    if (lua_istable(L, 3))
+    {
+        if (LUA_TNUMBER == lua_getfield(L, 3, "start"))
+            start = lua_tonumber(L, -1);
+
+        if (LUA_TTABLE == lua_getfield(L, 3, "offset"))
+            lua_tokeyframe_fallback(L, -1, &offset, &zero);
+
+        if (LUA_TTABLE == lua_getfield(L, 3, "scale"))
+            lua_tokeyframe_fallback(L, -1, &scale, &one);
+
+        lua_pop(L, 3);
+    }
+
+    render_interface_play_clip(widget->render_interface, clip, current_timestamp + start, &offset, &scale);
+
+    return 0;
+}
+
 // Genearl widget garbage collection
 static int gc(lua_State* L)
 {
     struct widget* const widget = (struct widget*)luaL_checkudata(L, 1, "widget_mt");
 
     call_engine(widget, gc);
+    widget_orphan_children(widget);
+    widget_set_parent(widget, NULL);
+    awake_remove(widget);
     queue_pop((struct widget_interface* const) widget);
+    event_unsubscribe(widget);
+    pick_index_remove(widget);
+    pick_readback_cancel();
+    widget_id_release(widget);
+
+    if (pick_result == widget)
+        pick_result = NULL;
+
+    pick_epoch++;
+
+    // Make sure we don't get stale pointers.
+    //  Lua has already cleared the udata from the weak widgets table, so it's put back while the lua callbacks run.
+    lua_rawgeti(L, LUA_REGISTRYINDEX, widgets_ref);
+    lua_pushvalue(L, 1);
+    lua_rawsetp(L, -2, widget);
 
-    // Make sure we don't get stale pointers
     prevent_stale_pointers(widget);
 
+    lua_pushnil(L);
+    lua_rawsetp(L, -2, widget);
+    lua_pop(L, 1);
+
+    // Recycle the widget's parts for the next widget made
+    if (widget->jump_table->pool)
+        widget_pool_free(widget->jump_table->pool, widget->upcast);
+
+    render_interface_release(widget->render_interface);
+    render_cache_release(&widget->cache);
+
     return 0;
 }
 
@@ -925,6 +2138,102 @@ static int snappable(lua_State* L)
     return 0;
 }
 
+// Set the widget's parent, nil makes it a root.
+//  The widget's keyframes become relative to the parent, so moving the parent moves the whole subtree.
+static int set_parent(lua_State* L)
+{
+    struct widget* const widget = (struct widget*)luaL_checkudata(L, -3, "widget_mt");
+    struct widget* const parent = lua_isnil(L, -1) ? NULL : (struct widget*)luaL_checkudata(L, -1, "widget_mt");
+
+    if (!widget_set_parent(widget, parent))
+        return luaL_error(L, "Widget can't be parented to its own descendant");
+
+    return 0;
+}
+
+static int get_parent(lua_State* L)
+{
+    struct widget* const widget = (struct widget*)luaL_checkudata(L, -2, "widget_mt");
+
+    if (widget->parent)
+        push_widget_udata(widget->parent);
+    else
+        lua_pushnil(L);
+
+    return 1;
+}
+
+// Hiding a widget hides its subtree
+static int set_hidden(lua_State* L)
+{
+    struct widget* const widget = (struct widget*)luaL_checkudata(L, -3, "widget_mt");
+
+    widget->hidden = lua_toboolean(L, -1);
+    cull_stamp++;
+    pick_epoch++;
+
+    return 0;
+}
+
+// Resize the widget
+static int set_width(lua_State* L)
+{
+    struct widget* const widget = (struct widget*)luaL_checkudata(L, -3, "widget_mt");
+
+    widget->render_interface->half_width = 0.5 * luaL_checknumber(L, -1);
+    widget_interface_reshape((struct widget_interface*)widget);
+
+    return 0;
+}
+
+static int set_height(lua_State* L)
+{
+    struct widget* const widget = (struct widget*)luaL_checkudata(L, -3, "widget_mt");
+
+    widget->render_interface->half_height = 0.5 * luaL_checknumber(L, -1);
+    widget_interface_reshape((struct widget_interface*)widget);
+
+    return 0;
+}
+
+static int get_width(lua_State* L)
+{
+    const struct widget* const widget = (struct widget*)luaL_checkudata(L, -2, "widget_mt");
+
+    lua_pushnumber(L, 2 * widget->render_interface->half_width);
+
+    return 1;
+}
+
+static int get_height(lua_State* L)
+{
+    const struct widget* const widget = (struct widget*)luaL_checkudata(L, -2, "widget_mt");
+
+    lua_pushnumber(L, 2 * widget->render_interface->half_height);
+
+    return 1;
+}
+
+static int get_hidden(lua_State* L)
+{
+    struct widget* const widget = (struct widget*)luaL_checkudata(L, -2, "widget_mt");
+
+    lua_pushboolean(L, widget->hidden);
+
+    return 1;
+}
+
+// Opt in to GPU evaluated keyframes
+static int gpu_keyframes(lua_State* L)
+{
+    struct widget_interface* const widget = (struct widget_interface*)luaL_checkudata(L, -3, "widget_mt");
+    int boolean = lua_toboolean(L, -1);
+
+    render_interface_gpu_keyframes(widget->render_interface, boolean);
+
+    return 0;
+}
+
 // Lua wrapper for the widget_interface_move
 static int widget_move_lua(lua_State* L)
 {
@@ -946,6 +2255,16 @@ static int widget_move_lua(lua_State* L)
     return 0;
 }
 
+// Lua wrapper for widget_interface_invalidate, for when what a cached widget draws changes on the lua side
+static int widget_invalidate_lua(lua_State* L)
+{
+    struct widget_interface* const widget = (struct widget_interface*)luaL_checkudata(L, -1, "widget_mt");
+
+    widget_interface_invalidate(widget);
+
+    return 0;
+}
+
 // Set context menu callback
 static int set_context_menu(lua_State* L)
 {
@@ -963,6 +2282,27 @@ static int engine_lock(lua_State* L)
     else
         lock = NULL;
 
+    z_order_dirty = true;
+    pick_epoch++;
+
+    return 0;
+}
+
+// Toggle depth sorted drawing, opaque widgets are drawn out of order to save on state changes
+static int engine_depth_sort(lua_State* L)
+{
+    depth_sort = lua_toboolean(L, -1);
+
+    return 0;
+}
+
+// Set the memory the render caches can use in bytes
+static int engine_render_cache_budget(lua_State* L)
+{
+    const lua_Integer budget = luaL_checkinteger(L, -1);
+
+    render_cache_budget(budget > 0 ? (size_t)budget : 0);
+
     return 0;
 }
 
@@ -970,52 +2310,62 @@ static int engine_lock(lua_State* L)
 static int engine_unlock(lua_State* L)
 {
     lock = queue_head;
+    z_order_dirty = true;
+    pick_epoch++;
 
     return 0;
 }
 
 // Geneal widget index method
+//  The keys are dispatched through perfect hashes built in widget_engine_init.
+static struct hash_table* index_table;
+static struct hash_table* newindex_table;
+
+static const struct {
+    const char* key;
+    const lua_CFunction function;
+    const enum
+    {
+        CALL_PUSH_CFUNCT,
+        CALL_CALL_FUNCT
+    } call_behaviour;
+} index_aa[] = {
+    {"set_keyframe",set_keyframe,CALL_PUSH_CFUNCT},
+    {"set_keyframes",set_keyframe,CALL_PUSH_CFUNCT},
+    {"destination_keyframe",destination_keyframe,CALL_CALL_FUNCT},
+    {"current_keyframe",current_keyframe,CALL_CALL_FUNCT},
+    {"push_keyframe",push_keyframe,CALL_PUSH_CFUNCT},
+    {"interupt",interupt,CALL_PUSH_CFUNCT},
+    {"enter_loop",enter_loop,CALL_PUSH_CFUNCT},
+    {"play_clip",play_clip,CALL_PUSH_CFUNCT},
+    {"parent",get_parent,CALL_CALL_FUNCT},
+    {"hidden",get_hidden,CALL_CALL_FUNCT},
+    {"width",get_width,CALL_CALL_FUNCT},
+    {"height",get_height,CALL_CALL_FUNCT},
+    {NULL,NULL,CALL_PUSH_CFUNCT},
+};
+
 static int index(lua_State* L)
 {
-    static const struct {
-        const char* key;
-        const lua_CFunction function;
-        const enum
-        {
-            CALL_PUSH_CFUNCT,
-            CALL_CALL_FUNCT
-        } call_behaviour;
-    } index_aa[] = {
-        {"set_keyframe",set_keyframe,CALL_PUSH_CFUNCT},
-        {"set_keyframes",set_keyframe,CALL_PUSH_CFUNCT},
-        {"destination_keyframe",destination_keyframe,CALL_CALL_FUNCT},
-        {"current_keyframe",current_keyframe,CALL_CALL_FUNCT},
-        {"push_keyframe",push_keyframe,CALL_PUSH_CFUNCT},
-        {"interupt",interupt,CALL_PUSH_CFUNCT},
-        {"enter_loop",enter_loop,CALL_PUSH_CFUNCT},
-        {NULL,NULL,CALL_PUSH_CFUNCT},
-    };
-
     struct widget* const widget = (struct widget*)luaL_checkudata(L, -2, "widget_mt");
     
     if (lua_type(L, -1) == LUA_TSTRING)
     {
-        const char* key = lua_tostring(L, -1);
+        const uint8_t i = hash_table_get(index_table, lua_tostring(L, -1));
 
-        for (size_t i = 0; index_aa[i].key; i++)
-            if(strcmp(index_aa[i].key, key) == 0)
+        if (i != HASH_TABLE_MISS)
+        {
+            if(index_aa[i].call_behaviour == CALL_PUSH_CFUNCT)
             {
-                if(index_aa[i].call_behaviour == CALL_PUSH_CFUNCT)
-                {
-                    lua_pushcfunction(L, index_aa[i].function);
-                    return 1;
-                }
+                lua_pushcfunction(L, index_aa[i].function);
+                return 1;
+            }
 
-                if (index_aa[i].call_behaviour == CALL_CALL_FUNCT)
-                {
-                    return index_aa[i].function(main_lua_state);
-                }
+            if (index_aa[i].call_behaviour == CALL_CALL_FUNCT)
+            {
+                return index_aa[i].function(main_lua_state);
             }
+        }
     }
 
     if (widget->jump_table->index)
@@ -1025,48 +2375,56 @@ static int index(lua_State* L)
 }
 
 // Geneal widget newindex method
-static int newindex(lua_State* L)
-{
 #define CALLBACK_ENTRY(callback,_,offset) {#callback,CALL_SET_CALLBACK, offset, NULL},
 
-    const struct {
-        const char* key;
-        const enum
-        {
-            CALL_SET_CALLBACK,
-            CALL_NEWINDEX_FUNCT
-        } call_behaviour;
-
-        int callback_offset;
-        int (*funct)(lua_State*);
-    } newindex_aa[] = {
-        {"snappable",CALL_NEWINDEX_FUNCT,0,snappable},
-        FOR_CALLBACKS(CALLBACK_ENTRY)
-        {NULL,CALL_NEWINDEX_FUNCT,0,NULL}
-    };
+static const struct {
+    const char* key;
+    const enum
+    {
+        CALL_SET_CALLBACK,
+        CALL_NEWINDEX_FUNCT
+    } call_behaviour;
+
+    int callback_offset;
+    int (*funct)(lua_State*);
+} newindex_aa[] = {
+    {"snappable",CALL_NEWINDEX_FUNCT,0,snappable},
+    {"gpu_keyframes",CALL_NEWINDEX_FUNCT,0,gpu_keyframes},
+    {"parent",CALL_NEWINDEX_FUNCT,0,set_parent},
+    {"hidden",CALL_NEWINDEX_FUNCT,0,set_hidden},
+    {"width",CALL_NEWINDEX_FUNCT,0,set_width},
+    {"height",CALL_NEWINDEX_FUNCT,0,set_height},
+    FOR_CALLBACKS(CALLBACK_ENTRY)
+    {NULL,CALL_NEWINDEX_FUNCT,0,NULL}
+};
 
+static int newindex(lua_State* L)
+{
     struct widget* const widget = (struct widget*)luaL_checkudata(L, -3, "widget_mt");
 
     if (lua_type(L, -2) == LUA_TSTRING)
     {
-        const char* key = lua_tostring(L, -2);
+        const uint8_t i = hash_table_get(newindex_table, lua_tostring(L, -2));
 
-        for (size_t i = 0; newindex_aa[i].key; i++)
-            if (strcmp(newindex_aa[i].key, key) == 0)
+        if (i != HASH_TABLE_MISS)
+        {
+            if (newindex_aa[i].call_behaviour == CALL_SET_CALLBACK
+                && lua_type(L, -1) == LUA_TFUNCTION)
             {
-                if (newindex_aa[i].call_behaviour == CALL_SET_CALLBACK
-                    && lua_type(L, -1) == LUA_TFUNCTION)
-                {
-                    int* handle = ((int*)&widget->lua.right_click) + newindex_aa[i].callback_offset;
-                    *handle = luaL_ref(L, LUA_REGISTRYINDEX);
-                    return 0;
-                }
+                push_callback_table(widget, -3);
+                lua_insert(L, -2);
+                lua_rawseti(L, -2, newindex_aa[i].callback_offset + 1);
+                lua_pop(L, 1);
 
-                if (newindex_aa[i].call_behaviour == CALL_NEWINDEX_FUNCT)
-                {
-                    return newindex_aa[i].funct(L);
-                }
+                widget->lua_callbacks |= 1u << newindex_aa[i].callback_offset;
+                return 0;
+            }
+
+            if (newindex_aa[i].call_behaviour == CALL_NEWINDEX_FUNCT)
+            {
+                return newindex_aa[i].funct(L);
             }
+        }
     }
 
     if (widget->jump_table->newindex)
@@ -1086,6 +2444,12 @@ void widget_engine_init()
     queue_head = NULL;
     queue_tail = NULL;
 
+    z_order = NULL;
+    z_order_used = 0;
+    z_order_allocated = 0;
+    z_order_lock = 0;
+    z_order_dirty = true;
+
     current_drop = NULL;
     current_hover = NULL;
     last_click = NULL;
@@ -1119,6 +2483,40 @@ void widget_engine_init()
         al_get_bitmap_width(al_get_target_bitmap()),
         al_get_bitmap_width(al_get_target_bitmap()));
 
+    // Build the pick spatial index grid
+    pick_grid_width = al_get_bitmap_width(al_get_target_bitmap()) / PICK_CELL_SIZE + 1;
+    pick_grid_height = al_get_bitmap_height(al_get_target_bitmap()) / PICK_CELL_SIZE + 1;
+    pick_grid = calloc(pick_grid_width * pick_grid_height, sizeof(struct pick_cell));
+    pick_unbounded = (struct pick_cell){ 0 };
+    pick_generation = 0;
+
+    // Pixel buffers for the asynchronous pick readback
+    for (size_t i = 0; i < 2; i++)
+    {
+        pick_readbacks[i].fence = NULL;
+        pick_readbacks[i].candidate_cnt = 0;
+
+        glGenBuffers(1, &pick_readbacks[i].buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pick_readbacks[i].buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4, NULL, GL_STREAM_READ);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pick_readback_idx = 0;
+
+    // The widget ID table, ID 0 is reserved for nothing
+    widget_ids_allocated = 64;
+    widget_ids_used = 1;
+    widget_ids = malloc(widget_ids_allocated * sizeof(struct widget*));
+    widget_ids[0] = NULL;
+    free_widget_ids = malloc(widget_ids_allocated * sizeof(size_t));
+    free_widget_ids_used = 0;
+
+    // Force the first pick
+    pick_epoch = 1;
+    pick_result_epoch = 0;
+    pick_result = NULL;
+
     // Make a weak global table to contain the widgets
     // And some functions for manipulating them
     lua_newtable(main_lua_state);
@@ -1132,16 +2530,33 @@ void widget_engine_init()
 
     const struct luaL_Reg widgets_methods[] = {
         {"move",widget_move_lua},
+        {"invalidate",widget_invalidate_lua},
         {"lock",engine_lock},
         {"unlock",engine_unlock},
+        {"depth_sort",engine_depth_sort},
+        {"render_cache_budget",engine_render_cache_budget},
         {NULL,NULL}
     };
 
     luaL_setfuncs(main_lua_state, widgets_methods, 0);
 
     lua_setmetatable(main_lua_state, -2);
+
+    lua_pushvalue(main_lua_state, -1);
+    widgets_ref = luaL_ref(main_lua_state, LUA_REGISTRYINDEX);
+
     lua_setglobal(main_lua_state, "widgets");
 
+    // Build the key dispatch hashes
+    index_table = hash_table_new_strided(index_aa, sizeof(index_aa[0]));
+    newindex_table = hash_table_new_strided(newindex_aa, sizeof(newindex_aa[0]));
+
+    if (!index_table || !newindex_table)
+    {
+        fprintf(stderr, "Failed to build widget key hashes.\n");
+        return;
+    }
+
     // Make the widget meta table
     luaL_newmetatable(main_lua_state, "widget_mt");
 
@@ -1162,6 +2577,30 @@ void widget_engine_init()
     lua_setglobal(main_lua_state, "contex_menu");
 }
 
+// Make room for cnt more widgets in every engine pool, so bulk construction grows each pool once.
+void widget_engine_reserve(size_t cnt)
+{
+    widget_id_reserve(cnt);
+    render_interface_reserve(cnt);
+
+    // z_order is rebuilt from the queue, so it needs room for every widget
+    size_t queue_cnt = 0;
+
+    for (const struct widget* widget = queue_head; widget; widget = widget->next)
+        queue_cnt++;
+
+    if (z_order_allocated >= queue_cnt + cnt)
+        return;
+
+    struct widget_hot* memsafe_hande = realloc(z_order, (queue_cnt + cnt) * sizeof(struct widget_hot));
+
+    if (!memsafe_hande)
+        return;
+
+    z_order = memsafe_hande;
+    z_order_allocated = queue_cnt + cnt;
+}
+
 // Allocate a new widget interface and wire it into the widget engine.
 // Consumes a table, if given
 struct widget_interface* widget_interface_new(
@@ -1170,7 +2609,8 @@ struct widget_interface* widget_interface_new(
 {
     const size_t widget_size = sizeof(struct widget);
 
-    struct widget* const widget = lua_newuserdatauv(main_lua_state, widget_size, (int)jump_table->uservalues);
+    // The extra uservalue holds the lua callbacks
+    struct widget* const widget = lua_newuserdatauv(main_lua_state, widget_size, (int)jump_table->uservalues + 1);
 
     if (!widget)
         return NULL;
@@ -1183,24 +2623,35 @@ struct widget_interface* widget_interface_new(
 
         .jump_table = jump_table,
 
-#define CLEAR_LUA_REFNIL(method,...) .lua. ## method = LUA_REFNIL,
-        FOR_CALLBACKS(CLEAR_LUA_REFNIL)     
+        .lua_callbacks = 0,
 
         .next = NULL,
         .previous = queue_tail,
         .is_draggable = false,
-        .is_snappable = false
+        .is_snappable = false,
+        .parent = NULL,
+        .children = 0,
+        .hidden = false,
+        .cull_stamp = cull_stamp - 1,
+        .awake = false,
+        .keep_awake = false,
+        .pick.indexed = false
     };
 
+    widget_id_assign(widget);
+    event_subscribe(widget);
+
+    // Widgets that don't update on demand are always awake
+    if (!jump_table->update_on_demand)
+        awake_push(widget);
+
     // Set Metatable
     luaL_getmetatable(main_lua_state, "widget_mt");
     lua_setmetatable(main_lua_state, -2);
 
-    lua_getglobal(main_lua_state, "widgets");
-    lua_pushlightuserdata(main_lua_state, widget);
-    lua_pushvalue(main_lua_state, -3);
-
-    lua_settable(main_lua_state, -3);
+    lua_rawgeti(main_lua_state, LUA_REGISTRYINDEX, widgets_ref);
+    lua_pushvalue(main_lua_state, -2);
+    lua_rawsetp(main_lua_state, -2, widget);
     lua_pop(main_lua_state, 1);
 
     // If a table is avalible, treat it like a init table
@@ -1237,6 +2688,8 @@ struct widget_interface* widget_interface_new(
     }
 
     queue_tail = widget;
+    z_order_dirty = true;
+    pick_epoch++;
 
     return (struct widget_interface*)widget;
 }
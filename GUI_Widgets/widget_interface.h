@@ -11,9 +11,45 @@
 #include "lua/lauxlib.h"
 #include "lua/lualib.h"
 
+// The event classes an event_handler can subscribe to through event_mask
+enum WIDGET_EVENT
+{
+	WIDGET_EVENT_KEYBOARD,
+	WIDGET_EVENT_MOUSE_AXES,
+	WIDGET_EVENT_MOUSE_BUTTON,
+	WIDGET_EVENT_TIMER,
+	WIDGET_EVENT_OTHER,
+	WIDGET_EVENT_CNT
+};
+
+#define WIDGET_EVENT_MASK(event) (1u << WIDGET_EVENT_ ## event)
+#define WIDGET_EVENT_ALL ((1u << WIDGET_EVENT_CNT) - 1)
+
+// Collected structs of one widget type, handed back out before malloc is called.
+struct widget_pool
+{
+	void** free;
+	size_t used, allocated;
+};
+
+void* widget_pool_alloc(struct widget_pool* const, size_t);
+void widget_pool_free(struct widget_pool* const, void*);
+
 struct widget_jump_table
 {
 	size_t uservalues;
+	unsigned int event_mask; // The event classes sent to event_handler, all of them if 0
+	struct widget_pool* pool; // If set the upcast is recycled into it after gc
+	bool update_on_demand; // If set update only runs while the widget is awake, see widget_interface_wake
+
+	// Non-zero if the widget is opaque, widgets with the same key share textures and materials.
+	//	Only read while depth sorting, see widget_engine_draw
+	size_t (*batch_key)(const struct widget_interface* const);
+
+	// Draws the widget by pushing sprites to the sprite batch instead of calling draw, false if it can't.
+	bool (*instance)(const struct widget_interface* const);
+
+	bool cache_draw; // If set draw is rendered into a cache and reused until widget_interface_invalidate
 
 	void (*gc)(struct widget_interface* const);
 
@@ -58,7 +94,12 @@ struct widget_interface* check_widget_lua(int , const struct widget_jump_table*
 struct widget_interface* check_widget(struct widget_interface*, const struct widget_jump_table* const);
 	
 void widget_screen_to_local(const struct widget_interface* const, double*, double*);
+void widget_screen_to_local_cached(const struct widget_interface* const, double*, double*);
 
 void stack_dump(lua_State*);
 
 void widget_interface_move(struct widget_interface*, struct widget_interface*);
+void widget_engine_reserve(size_t);
+void widget_interface_wake(struct widget_interface* const);
+void widget_interface_invalidate(struct widget_interface* const);
+void widget_interface_reshape(struct widget_interface* const);
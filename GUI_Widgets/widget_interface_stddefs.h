@@ -41,8 +41,12 @@ const double half_height = widget_interface->render_interface->half_height; \
 WG_CAST_CONST \
 WG_DIMENSIONS
 
+#define _WG_POOL(type) (&type ## _pool_entry)
+#define _WG_POOL_EXPANSION_BIND(type) _WG_POOL(type)
+#define WG_POOL _WG_POOL_EXPANSION_BIND(WIDGET_TYPE)
+
 #define WG_NEW \
-struct WIDGET_TYPE * WIDGET_TYPE = malloc(sizeof(struct WIDGET_TYPE)); \
+struct WIDGET_TYPE * WIDGET_TYPE = widget_pool_alloc(WG_POOL, sizeof(struct WIDGET_TYPE)); \
 if (!WIDGET_TYPE) return 0; \
 *WIDGET_TYPE = (struct WIDGET_TYPE)
 
@@ -52,6 +56,7 @@ if (!WIDGET_TYPE) return 0; \
 #define WG_NEW_HEADER _WG_NEW_HEADER_EXPANSION_BIND(WIDGET_TYPE)
 
 #define _WG_JMP_TBL(type) \
+static struct widget_pool type ## _pool_entry; \
 static const struct widget_jump_table type ## _jump_table_entry =
 #define _WG_JMP_TBL_EXPANSION_BIND(type) _WG_JMP_TBL(type)
 #define WG_JMP_TBL _WG_JMP_TBL_EXPANSION_BIND(WIDGET_TYPE)